@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Microbenchmarks of the search engine
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = match_bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += match_bench.cpp \
+    ../name_matcher.cpp
+
+HEADERS += ../name_matcher.h
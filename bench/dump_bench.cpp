@@ -0,0 +1,532 @@
+// End to end benchmarks over a synthetic dump.
+// Usage: dump_bench generate DIR [rows]
+//        dump_bench run DIR
+//        dump_bench check DIR
+//
+// generate writes DIR/final.txt, DIR/final.txt.gz and a descriptions
+// tree DIR/descriptions/XXX/XXXXX.tar.gz; the same row count gives the
+// same files. run times the search engine over them and prints one JSON
+// object per benchmark to stdout, to be tracked across commits. run
+// builds the indexes itself, so it is meant for freshly generated files.
+// check builds them too and verifies the search plans over them.
+
+#include <QtCore>
+#include <climits>
+#include <stdio.h>
+#include <zlib.h>
+#include "gzip/gzip.h"
+#include "quazip/quagzipfile.h"
+#include "dump_line.h"
+#include "searching_thread.h"
+#include "results_model.h"
+#include "dump_indexer.h"
+#include "gzip_pipeline.h"
+#include "description_archive.h"
+#include "description_cache.h"
+#include "description_loader.h"
+#include "description_store.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+const char* WORDS[] = {
+    "Сборник", "музыки", "Фильм", "сериал", "сезон", "Lossless", "FLAC",
+    "MP3", "The", "Best", "Of", "Коллекция", "Мультфильмы", "Windows",
+    "Linux", "Ubuntu", "Книги", "аудиокнига", "Rock", "Jazz", "Classic",
+    "Документальный", "фильм", "HDTVRip", "DVDRip", "1080p", "720p",
+    "Матрица", "Властелин", "колец", "Discography", "Дискография", "2012"
+};
+
+const int WORDS_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+const char* MONTHS[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+const int DEFAULT_ROWS = 1000000;
+const int FIRST_ID = 1000000;
+// every n-th line uses the '|' separator of older dumps
+const int PIPE_EVERY = 10;
+// every n-th topic has a description
+const int DESCRIPTION_EVERY = 3;
+const int DESCRIPTION_LOOKUPS = 200;
+const int ADD_ROWS = 200000;
+const int TAR_BLOCK = 512;
+
+// deterministic across platforms, unlike qrand
+class Random {
+public:
+    Random(quint32 seed): state_(seed) {
+    }
+
+    quint32 next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    int below(int n) {
+        return int(next() % quint32(n));
+    }
+
+private:
+    quint32 state_;
+};
+
+QString paddedId(int id) {
+    return QString("%1").arg(id, 8, 10, QChar('0'));
+}
+
+QByteArray makeName(Random* random) {
+    QStringList words;
+    int n = 3 + random->below(8);
+    for (int j = 0; j < n; j++) {
+        words << QString::fromUtf8(WORDS[random->below(WORDS_COUNT)]);
+    }
+    return words.join(" ").toUtf8();
+}
+
+QByteArray makeHash(Random* random) {
+    QByteArray hash(20, 0);
+    for (int i = 0; i < hash.size(); i++) {
+        hash[i] = char(random->below(256));
+    }
+    return hash.toHex().toUpper();
+}
+
+QByteArray makeDescription(Random* random, int id, const QByteArray& name) {
+    QByteArray html = "<div class=\"post_body\"><span style=\"font-size: 24px;\">" +
+                      name + "</span><hr class=\"post-hr\">\n";
+    int paragraphs = 2 + random->below(6);
+    for (int i = 0; i < paragraphs; i++) {
+        html += "<span class=\"post-b\">" + makeName(random) + "</span>: " +
+                makeName(random) + "<br>\n";
+    }
+    html += "<a href=\"viewtopic.php?t=" + QByteArray::number(id) +
+            "\" class=\"postLink\">" + makeName(random) + "</a></div>\n";
+    return html;
+}
+
+QByteArray octal(qint64 value, int size) {
+    QByteArray field = QByteArray::number(value, 8).rightJustified(size - 1, '0');
+    field += '\0';
+    return field;
+}
+
+void appendTarMember(QByteArray* tar, const QByteArray& name, const QByteArray& data) {
+    QByteArray header(TAR_BLOCK, '\0');
+    header.replace(0, name.size(), name);
+    header.replace(100, 8, octal(0644, 8));
+    header.replace(108, 8, octal(0, 8));
+    header.replace(116, 8, octal(0, 8));
+    header.replace(124, 12, octal(data.size(), 12));
+    header.replace(136, 12, octal(0, 12));
+    header[156] = '0';
+    header.replace(257, 6, QByteArray("ustar\0", 6));
+    header.replace(263, 2, "00");
+    // the checksum is computed with its own field as spaces
+    header.replace(148, 8, QByteArray(8, ' '));
+    int checksum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) {
+        checksum += (unsigned char)header[i];
+    }
+    header.replace(148, 8, octal(checksum, 7) + ' ');
+    *tar += header;
+    *tar += data;
+    *tar += QByteArray((TAR_BLOCK - data.size() % TAR_BLOCK) % TAR_BLOCK, '\0');
+}
+
+bool writeArchive(const QString& root, const QString& bucket,
+                  const QMap<int, QByteArray>& files) {
+    QDir dir(root);
+    dir.mkpath(bucket.left(3));
+    QByteArray tar;
+    for (QMap<int, QByteArray>::const_iterator it = files.constBegin();
+            it != files.constEnd(); ++it) {
+        appendTarMember(&tar, paddedId(it.key()).toLatin1(), it.value());
+    }
+    tar += QByteArray(2 * TAR_BLOCK, '\0');
+    QFile file(dir.absoluteFilePath(bucket.left(3) + "/" + bucket + ".tar.gz"));
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+           file.write(bugless::gzip::compress(tar)) > 0;
+}
+
+int generate(const QString& dir_path, int rows) {
+    QDir dir(dir_path);
+    dir.mkpath(".");
+    dir.mkpath("descriptions");
+    QString root = dir.absoluteFilePath("descriptions");
+    QFile dump(dir.absoluteFilePath("final.txt"));
+    gzFile gz = gzopen(QFile::encodeName(dir.absoluteFilePath("final.txt.gz")).constData(), "wb");
+    if (!dump.open(QIODevice::WriteOnly | QIODevice::Truncate) || !gz) {
+        fprintf(stderr, "can not write to %s\n", qPrintable(dir_path));
+        return 1;
+    }
+    Random random(rows + 1);
+    int id = FIRST_ID;
+    QString bucket;
+    QMap<int, QByteArray> files;
+    for (int i = 0; i < rows; i++) {
+        // a few ids of deleted topics are missing
+        id += 1 + (random.below(8) == 0 ? 1 + random.below(3) : 0);
+        QByteArray name = makeName(&random);
+        char separator = i % PIPE_EVERY == 0 ? '|' : '\t';
+        QByteArray updated = QByteArray::number(1 + random.below(28)).rightJustified(2, '0') +
+                             "-" + MONTHS[random.below(12)] + "-" +
+                             QByteArray::number(5 + random.below(9)).rightJustified(2, '0') +
+                             " " + QByteArray::number(random.below(24)).rightJustified(2, '0') +
+                             ":" + QByteArray::number(random.below(60)).rightJustified(2, '0');
+        QList<QByteArray> fields;
+        fields << QByteArray::number(id) << name
+               << QByteArray::number(qint64(random.next() % 50000) * 1024 * 1024)
+               << QByteArray::number(random.below(1000))
+               << QByteArray::number(random.below(100)) << makeHash(&random)
+               << QByteArray::number(random.below(100000)) << updated;
+        QByteArray line = fields[0];
+        for (int f = 1; f < fields.size(); f++) {
+            line += separator;
+            line += fields[f];
+        }
+        line += '\n';
+        if (dump.write(line) != line.size() || gzwrite(gz, line.constData(), line.size()) <= 0) {
+            fprintf(stderr, "can not write the dump\n");
+            return 1;
+        }
+        if (i % DESCRIPTION_EVERY == 0) {
+            QString id_bucket = descriptionBucket(id);
+            if (id_bucket != bucket && !files.isEmpty() && !writeArchive(root, bucket, files)) {
+                fprintf(stderr, "can not write archive %s\n", qPrintable(bucket));
+                return 1;
+            }
+            if (id_bucket != bucket) {
+                files.clear();
+                bucket = id_bucket;
+            }
+            files[id] = makeDescription(&random, id, name);
+        }
+    }
+    if (!files.isEmpty() && !writeArchive(root, bucket, files)) {
+        return 1;
+    }
+    gzclose(gz);
+    return 0;
+}
+
+// Counts the hits of a search; chunks come from several scanners.
+class HitCounter : public QObject {
+    Q_OBJECT
+public:
+    HitCounter(): hits_(0) {
+    }
+
+    int hits() const {
+        return hits_;
+    }
+
+public slots:
+    void addResults(ResultStore_ptr results) {
+        hits_.fetchAndAddOrdered(results->size());
+    }
+
+private:
+    QAtomicInt hits_;
+};
+
+void report(const char* bench, const QString& detail, qint64 ms, qint64 items) {
+    QByteArray detail_utf8 = detail.toUtf8();
+    printf("{\"bench\":\"%s\",\"detail\":\"%s\",\"ms\":%lld,\"items\":%lld}\n",
+           bench, detail_utf8.constData(), ms, items);
+    fflush(stdout);
+}
+
+// Runs a search to the end, -1 if the dump can not be opened.
+int runSearch(const QString& path, const QString& pattern, SearchingThread::Plan* plan,
+              int limit = INT_MAX, int sort_field = -1) {
+    QIODevice* input = path.endsWith(".gz") ? (QIODevice*)new QuaGzipFile(path) :
+                                              (QIODevice*)new QFile(path);
+    QScopedPointer<QIODevice> input_guard(input);
+    if (!input->open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "can not open %s\n", qPrintable(path));
+        return -1;
+    }
+    HitCounter counter;
+    SearchingThread thread(input, limit, pattern, false);
+    thread.setAutoDelete(false);
+    if (sort_field >= 0) {
+        thread.setTopBy(sort_field);
+    }
+    QObject::connect(&thread, SIGNAL(newResults(ResultStore_ptr)),
+                     &counter, SLOT(addResults(ResultStore_ptr)),
+                     Qt::DirectConnection);
+    thread.run();
+    *plan = thread.plan();
+    return counter.hits();
+}
+
+const char* planName(SearchingThread::Plan plan) {
+    switch (plan) {
+    case SearchingThread::PLAN_KEYS:
+        return "key indexes";
+    case SearchingThread::PLAN_NAME_INDEX:
+        return "name index";
+    case SearchingThread::PLAN_SNAPSHOT:
+        return "snapshot scan";
+    case SearchingThread::PLAN_SCAN:
+        return "dump scan";
+    default:
+        return "none";
+    }
+}
+
+// The detail names the plan taken, so that a bench label can not hide
+// a fallback to another plan.
+void benchSearch(const char* bench, const QString& path, const QString& pattern,
+                 int limit = INT_MAX, int sort_field = -1) {
+    SearchingThread::Plan plan = SearchingThread::PLAN_NONE;
+    QElapsedTimer timer;
+    timer.start();
+    int hits = runSearch(path, pattern, &plan, limit, sort_field);
+    if (hits >= 0) {
+        report(bench, pattern + " via " + planName(plan), timer.elapsed(), hits);
+    }
+}
+
+// Parsing is the scanners' share of a hit, adding the window's.
+void benchAddRows(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QList<QByteArray> lines;
+    for (int i = 0; i < ADD_ROWS && !file.atEnd(); i++) {
+        lines << file.readLine();
+    }
+    // in chunks of 1000, as the search sends them once it is under way
+    QList<ResultStore_ptr> chunks;
+    QElapsedTimer timer;
+    timer.start();
+    foreach (const QByteArray& line, lines) {
+        RecordFields fields;
+        if (!splitRecord(line.constData(), line.size(), &fields)) {
+            continue;
+        }
+        if (chunks.isEmpty() || chunks.last()->size() >= 1000) {
+            chunks << ResultStore_ptr(new ResultStore);
+        }
+        chunks.last()->append(ResultRecord(fields));
+    }
+    report("parse_rows", "", timer.elapsed(), lines.size());
+    ResultsModel model;
+    timer.restart();
+    foreach (const ResultStore_ptr& chunk, chunks) {
+        model.addResults(*chunk);
+    }
+    report("add_rows", "", timer.elapsed(), model.rowCount());
+}
+
+void benchDescriptions(const char* bench, const DescriptionSource& source,
+                       const QList<int>& ids) {
+    source.cache->clear();
+    int found = 0;
+    QElapsedTimer timer;
+    timer.start();
+    foreach (int id, ids) {
+        if (!loadDescription(source, id).isEmpty()) {
+            found += 1;
+        }
+    }
+    report(bench, QString::number(ids.size()) + " lookups", timer.elapsed(), found);
+}
+
+void benchBase32(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QStringList hashes;
+    while (!file.atEnd() && hashes.size() < ADD_ROWS) {
+        QByteArray line = file.readLine();
+        RecordFields fields;
+        if (splitRecord(line.constData(), line.size(), &fields)) {
+            hashes << QString::fromLatin1(fields.field(FIELD_HASH));
+        }
+    }
+    int same = 0;
+    QElapsedTimer timer;
+    timer.start();
+    foreach (const QString& hash, hashes) {
+        if (base32_to_hex(hex_to_base32(hash)) == hash) {
+            same += 1;
+        }
+    }
+    report("base32", "hex to base32 and back", timer.elapsed(), same);
+}
+
+int run(const QString& dir_path) {
+    QDir dir(dir_path);
+    QString dump = dir.absoluteFilePath("final.txt");
+    QString gz_dump = dir.absoluteFilePath("final.txt.gz");
+    QString root = dir.absoluteFilePath("descriptions");
+    if (!QFile(dump).exists() || !QFile(gz_dump).exists()) {
+        fprintf(stderr, "no dump in %s, run generate first\n", qPrintable(dir_path));
+        return 1;
+    }
+    QStringList patterns;
+    patterns << "flac" << QString::fromUtf8("матрица") << QString::fromUtf8("нет такого");
+
+    foreach (const QString& pattern, patterns) {
+        benchSearch("full_scan", dump, pattern);
+    }
+    // the 100 most downloaded of every match, in one pass
+    benchSearch("top_downloads", dump, patterns[0], 100, FIELD_DOWNLOADS);
+    foreach (const QString& pattern, patterns) {
+        benchSearch("gz_scan", gz_dump, pattern);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    IndexingThread(dump).run();
+    report("build_index", "final.txt", timer.elapsed(), QFileInfo(dump).size());
+    foreach (const QString& pattern, patterns) {
+        benchSearch("indexed_search", dump, pattern);
+    }
+
+    benchAddRows(dump);
+    benchBase32(dump);
+
+    // the same spread of ids for every description source
+    QList<int> ids;
+    Random random(DESCRIPTION_LOOKUPS);
+    QFile file(dump);
+    if (file.open(QIODevice::ReadOnly)) {
+        qint64 size = file.size();
+        for (int i = 0; i < DESCRIPTION_LOOKUPS; i++) {
+            file.seek(qint64(random.next()) * size / 0x100000000LL);
+            file.readLine();
+            RecordFields fields;
+            QByteArray line = file.readLine();
+            if (splitRecord(line.constData(), line.size(), &fields)) {
+                ids << fields.field(FIELD_ID).toInt();
+            }
+        }
+    }
+    DescriptionCache cache;
+    DescriptionSource source;
+    source.root = root;
+    source.cache = &cache;
+    benchDescriptions("description_by_id", source, ids);
+    timer.restart();
+    DescriptionIndexingThread(root).run();
+    report("index_descriptions", "", timer.elapsed(), 0);
+    benchDescriptions("description_by_id_indexed", source, ids);
+    source.ids = IdIndex_ptr(new IdIndex);
+    if (DescriptionIndexingThread::openIds(root, source.ids.data())) {
+        benchDescriptions("description_by_id_id_table", source, ids);
+    }
+    timer.restart();
+    DescriptionPackingThread(root, true).run();
+    report("pack_descriptions", "", timer.elapsed(), 0);
+    source.store = DescriptionStore_ptr(new DescriptionStore);
+    if (source.store->open(DescriptionStore::storePath(root))) {
+        benchDescriptions("description_by_id_store", source, ids);
+    }
+    return 0;
+}
+
+bool expect(bool condition, const QByteArray& what) {
+    printf("%s: %s\n", condition ? "ok" : "FAILED", what.constData());
+    return condition;
+}
+
+// Reads a compressed dump through the pipeline; false if it failed.
+bool inflates(const QString& gz_path) {
+    GzipPipeline pipeline(gz_path);
+    if (!pipeline.start()) {
+        return false;
+    }
+    GzipPipeline::Block block;
+    while (pipeline.next(&block)) {
+        pipeline.release(block);
+    }
+    return !pipeline.failed();
+}
+
+// Checks that the planner takes the indexes it has and that they find what
+// a scan finds, and that cut compressed dumps are reported as broken.
+// Exits with 1 if any check fails.
+int check(const QString& dir_path) {
+    QDir dir(dir_path);
+    QString dump = dir.absoluteFilePath("final.txt");
+    QString gz_dump = dir.absoluteFilePath("final.txt.gz");
+    if (!QFile(dump).exists() || !QFile(gz_dump).exists()) {
+        fprintf(stderr, "no dump in %s, run generate first\n", qPrintable(dir_path));
+        return 1;
+    }
+    IndexingThread(dump).run();
+    bool ok = true;
+    QStringList patterns;
+    patterns << "flac" << QString::fromUtf8("матрица") << "flac OR rock";
+    foreach (const QString& pattern, patterns) {
+        QByteArray what = pattern.toUtf8();
+        SearchingThread::Plan plan = SearchingThread::PLAN_NONE;
+        // the compressed dump has no indexes of its own
+        int scanned = runSearch(gz_dump, pattern, &plan);
+        ok = expect(plan == SearchingThread::PLAN_SCAN, "gz dump is scanned: " + what) && ok;
+        int indexed = runSearch(dump, pattern, &plan);
+        ok = expect(plan == SearchingThread::PLAN_NAME_INDEX,
+                    "name index is used: " + what) && ok;
+        ok = expect(indexed > 0 && indexed == scanned,
+                    "name index finds what a scan finds: " + what) && ok;
+    }
+    // too short for a trigram
+    SearchingThread::Plan plan = SearchingThread::PLAN_NONE;
+    runSearch(dump, "fl", &plan);
+    ok = expect(plan == SearchingThread::PLAN_SNAPSHOT, "short terms scan the snapshot") && ok;
+
+    ok = expect(inflates(gz_dump), "whole gzip file inflates") && ok;
+    QString cut_dump = dir.absoluteFilePath("truncated.txt.gz");
+    QFile gz_file(gz_dump);
+    QFile cut_file(cut_dump);
+    if (gz_file.open(QIODevice::ReadOnly) &&
+        cut_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        cut_file.write(gz_file.read(gz_file.size() / 2));
+        cut_file.close();
+        ok = expect(!inflates(cut_dump), "truncated gzip file fails") && ok;
+    } else {
+        ok = expect(false, "truncated gzip file is written") && ok;
+    }
+    QFile::remove(cut_dump);
+    return ok ? 0 : 1;
+}
+
+// the engine logs every step, which is not part of the output
+void quietDebug(QtMsgType type, const char* message) {
+    if (type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    qInstallMsgHandler(quietDebug);
+    QStringList args = app.arguments();
+    if (args.size() >= 3 && args[1] == "generate") {
+        int rows = args.size() > 3 ? args[3].toInt() : DEFAULT_ROWS;
+        return generate(args[2], rows);
+    }
+    if (args.size() >= 3 && args[1] == "run") {
+        return run(args[2]);
+    }
+    if (args.size() >= 3 && args[1] == "check") {
+        return check(args[2]);
+    }
+    fprintf(stderr, "usage: dump_bench generate DIR [rows]\n"
+                    "       dump_bench run DIR\n"
+                    "       dump_bench check DIR\n");
+    return 2;
+}
+
+#include "dump_bench.moc"
@@ -0,0 +1,82 @@
+#-------------------------------------------------
+#
+# End to end benchmarks over a synthetic dump
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = dump_bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += .. ../bugless ../bugless/tar ../bugless/gzip ../bugless/util ../bugless/zip
+DEFINES += BUGLESS_TAR BUGLESS_GZIP BUGLESS_ZIP
+!win32:LIBS += -lz
+
+SOURCES += dump_bench.cpp \
+    ../torrent_hash_convert.cpp \
+    ../name_index.cpp \
+    ../dump_line.cpp \
+    ../dump_snapshot.cpp \
+    ../dump_indexer.cpp \
+    ../name_matcher.cpp \
+    ../searching_thread.cpp \
+    ../gzip_index.cpp \
+    ../gzip_pipeline.cpp \
+    ../description_archive.cpp \
+    ../description_cache.cpp \
+    ../description_loader.cpp \
+    ../description_store.cpp \
+    ../hash_index.cpp \
+    ../id_index.cpp \
+    ../search_query.cpp \
+    ../result_store.cpp \
+    ../result_ring.cpp \
+    ../results_model.cpp \
+    ../arpmanetdc/base32.cpp \
+    ../arpmanetdc/util.cpp \
+    ../quazip/quagzipfile.cpp \
+    ../bugless/tar/TarDevice.cpp \
+    ../bugless/tar/Tar.cpp \
+    ../bugless/tar/TarImpl.cpp \
+    ../bugless/ZipDevice.cpp \
+    ../bugless/ArchiveFactory.cpp \
+    ../bugless/ArchiveImpl.cpp \
+    ../bugless/gzip/gzip.cpp \
+    ../bugless/ArchiveDevice.cpp \
+    ../bugless/ArchiveIterator.cpp \
+    ../bugless/util/dirUtils.cpp \
+    ../bugless/util/fileUtils.cpp \
+    ../bugless/ZipImpl.cpp \
+    ../bugless/IOCompressorImpl.cpp \
+    ../bugless/Archive.cpp \
+    ../bugless/zip/qiodeviceapi.cpp \
+    ../bugless/zip/unzip.c \
+    ../bugless/zip/ioapi.c \
+    ../bugless/zip/qzip.c
+
+HEADERS += ../torrent_hash_convert.h \
+    ../name_index.h \
+    ../dump_line.h \
+    ../dump_snapshot.h \
+    ../dump_indexer.h \
+    ../name_matcher.h \
+    ../searching_thread.h \
+    ../gzip_index.h \
+    ../gzip_pipeline.h \
+    ../description_archive.h \
+    ../description_cache.h \
+    ../description_loader.h \
+    ../description_store.h \
+    ../hash_index.h \
+    ../id_index.h \
+    ../search_query.h \
+    ../result_store.h \
+    ../result_ring.h \
+    ../results_model.h \
+    ../quazip/quagzipfile.h \
+    ../bugless/tar/TarDevice.h \
+    ../bugless/IOCompressorImpl.h \
+    ../bugless/ArchiveImpl.h
@@ -0,0 +1,99 @@
+// Compares NameMatcher with the QString::contains path it replaced.
+// Usage: match_bench [names] [pattern]
+
+#include <QtCore>
+#include <stdio.h>
+#include "name_matcher.h"
+
+namespace {
+
+const char* WORDS[] = {
+    "Сборник", "музыки", "Фильм", "сериал", "сезон", "Lossless", "FLAC",
+    "MP3", "The", "Best", "Of", "Коллекция", "Мультфильмы", "Windows",
+    "Linux", "Ubuntu", "Книги", "аудиокнига", "Rock", "Jazz", "Classic",
+    "Документальный", "фильм", "HDTVRip", "DVDRip", "1080p", "720p",
+    "Матрица", "Властелин", "колец", "Discography", "Дискография", "2012"
+};
+
+const int WORDS_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+struct Names {
+    QByteArray text;
+    QVector<int> offsets; // offsets.size() == names + 1
+};
+
+Names makeNames(int count, QTextCodec* codec) {
+    Names names;
+    qsrand(1);
+    for (int i = 0; i < count; i++) {
+        names.offsets << names.text.size();
+        QStringList words;
+        int n = 3 + qrand() % 8;
+        for (int j = 0; j < n; j++) {
+            words << QString::fromUtf8(WORDS[qrand() % WORDS_COUNT]);
+        }
+        names.text += codec->fromUnicode(words.join(" "));
+    }
+    names.offsets << names.text.size();
+    return names;
+}
+
+void run(const char* title, const Names& names, const QString& pattern, QTextCodec* codec) {
+    const char* text = names.text.constData();
+    int count = names.offsets.size() - 1;
+
+    QElapsedTimer timer;
+    timer.start();
+    int qstring_hits = 0;
+    for (int i = 0; i < count; i++) {
+        int size = names.offsets[i + 1] - names.offsets[i];
+        QString name = codec->toUnicode(text + names.offsets[i], size);
+        if (name.contains(pattern, Qt::CaseInsensitive)) {
+            qstring_hits += 1;
+        }
+    }
+    qint64 qstring_ms = timer.elapsed();
+
+    NameMatcher matcher(pattern, codec->name() != "UTF-8");
+    timer.restart();
+    int matcher_hits = 0;
+    for (int i = 0; i < count; i++) {
+        int size = names.offsets[i + 1] - names.offsets[i];
+        if (matcher.matches(text + names.offsets[i], size)) {
+            matcher_hits += 1;
+        }
+    }
+    qint64 matcher_ms = timer.elapsed();
+
+    printf("%-8s %-16s QString %6lld ms, NameMatcher(%s) %6lld ms, x%.1f%s\n",
+           title, pattern.toUtf8().constData(),
+           qstring_ms, NameMatcher::kernelName(), matcher_ms,
+           double(qstring_ms) / qMax(matcher_ms, qint64(1)),
+           qstring_hits == matcher_hits ? "" : "  HITS DIFFER");
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    int count = args.size() > 1 ? args[1].toInt() : 1000000;
+    QStringList patterns;
+    if (args.size() > 2) {
+        patterns << args[2];
+    } else {
+        patterns << QString::fromUtf8("матрица") << "flac"
+                 << QString::fromUtf8("ДИСКОГРАФИЯ") << "1080p"
+                 << QString::fromUtf8("нет такого");
+    }
+    QTextCodec* utf8 = QTextCodec::codecForName("UTF-8");
+    QTextCodec* cp1251 = QTextCodec::codecForName("Windows-1251");
+    Names utf8_names = makeNames(count, utf8);
+    Names cp1251_names = makeNames(count, cp1251);
+    printf("%d names, %d MB\n", count, utf8_names.text.size() / (1024 * 1024));
+    foreach (const QString& pattern, patterns) {
+        run("utf-8", utf8_names, pattern, utf8);
+        run("cp1251", cp1251_names, pattern, cp1251);
+    }
+    return 0;
+}
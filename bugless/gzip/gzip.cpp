@@ -193,6 +193,82 @@ QByteArray uncompress_(const uchar* data, int nbytes)
     return baunzip;
 }
 
+
+QByteArray compressDict_(const QByteArray& data, const QByteArray& dictionary, int compressionLevel)
+{
+    z_stream stream;
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    if (deflateInit(&stream, compressionLevel) != Z_OK)
+        return QByteArray();
+    if (!dictionary.isEmpty() &&
+        deflateSetDictionary(&stream, (const Bytef*)dictionary.constData(), dictionary.size()) != Z_OK)
+    {
+        deflateEnd(&stream);
+        return QByteArray();
+    }
+
+    QByteArray bazip(4 + deflateBound(&stream, data.size()), '\0');
+    const uint nbytes = data.size();
+    bazip[0] = (nbytes >> 24) & 0xff;
+    bazip[1] = (nbytes >> 16) & 0xff;
+    bazip[2] = (nbytes >> 8) & 0xff;
+    bazip[3] = nbytes & 0xff;
+    stream.next_in = (Bytef*)data.constData();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef*)bazip.data() + 4;
+    stream.avail_out = bazip.size() - 4;
+
+    int err = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (err != Z_STREAM_END)
+    {
+        qWarning("compress: deflate with dictionary failed");
+        return QByteArray();
+    }
+    bazip.resize(4 + stream.total_out);
+    return bazip;
+}
+
+
+QByteArray uncompressDict_(const QByteArray& data, const QByteArray& dictionary)
+{
+    if (data.size() <= 4)
+        return QByteArray();
+    const uchar* p = reinterpret_cast<const uchar*>(data.constData());
+    const ulong expectedSize = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+
+    z_stream stream;
+    stream.zalloc = (alloc_func)0;
+    stream.zfree = (free_func)0;
+    stream.opaque = (voidpf)0;
+    stream.next_in = (Bytef*)p + 4;
+    stream.avail_in = data.size() - 4;
+    if (inflateInit(&stream) != Z_OK)
+        return QByteArray();
+
+    QByteArray baunzip(qMax(expectedSize, 1ul), '\0');
+    stream.next_out = (Bytef*)baunzip.data();
+    stream.avail_out = baunzip.size();
+    int err = inflate(&stream, Z_FINISH);
+    if (err == Z_NEED_DICT)
+    {
+        // the dictionary id in the stream is checked by zlib
+        err = inflateSetDictionary(&stream, (const Bytef*)dictionary.constData(), dictionary.size());
+        if (err == Z_OK)
+            err = inflate(&stream, Z_FINISH);
+    }
+    inflateEnd(&stream);
+    if (err != Z_STREAM_END || stream.total_out != expectedSize)
+    {
+        qWarning("uncompress: Input data is corrupted or the dictionary is wrong");
+        return QByteArray();
+    }
+    baunzip.resize(expectedSize);
+    return baunzip;
+}
+
 } // end of anonymous namespace
 
 namespace bugless { namespace gzip {
@@ -213,4 +289,16 @@ QByteArray uncompress( const QByteArray& data )
     return uncompress_( reinterpret_cast<const uchar*>( data.constData() ), data.size() ); 
 }
 
+
+QByteArray compress( const QByteArray& data, const QByteArray& dictionary )
+{
+    return compressDict_( data, dictionary, Z_BEST_COMPRESSION );
+}
+
+
+QByteArray uncompress( const QByteArray& data, const QByteArray& dictionary )
+{
+    return uncompressDict_( data, dictionary );
+}
+
 } } // of namespace bugless::gzip
@@ -21,6 +21,16 @@ QByteArray compress( const QByteArray& data );
 
 QByteArray uncompress( const QByteArray& data );
 
+/*!
+    Variants with a preset dictionary (deflateSetDictionary). The gzip
+    wrapper does not allow one, so the data is a zlib stream after the
+    uncompressed size in four bytes, msb first, as in qCompress.
+*/
+
+QByteArray compress( const QByteArray& data, const QByteArray& dictionary );
+
+QByteArray uncompress( const QByteArray& data, const QByteArray& dictionary );
+
 void test();
 
 } } // of namespace bugless::gzip
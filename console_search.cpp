@@ -0,0 +1,200 @@
+#include "console_search.h"
+#include <climits>
+#include "quazip/quagzipfile.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+const int FLUSH_MS = 200;
+
+QDir appDir() {
+    return QFileInfo(QCoreApplication::applicationFilePath()).absoluteDir();
+}
+
+QString optionValue(const QStringList& args, const QString& name) {
+    int i = args.indexOf(name);
+    return i >= 0 && i + 1 < args.size() ? args[i + 1] : QString();
+}
+
+void usage() {
+    fprintf(stderr, "usage: dump_viewer --query TEXT [--limit N] [--sort FIELD]\n"
+                    "                   [--format tsv|json] [--dump PATH] [--cp1251]\n");
+}
+
+// tabs and line ends would break the columns
+QByteArray tsvField(const char* data, int size) {
+    QByteArray field(data, size);
+    field.replace('\t', ' ').replace('\n', ' ').replace('\r', ' ');
+    return field;
+}
+
+QByteArray updatedString(uint updated) {
+    if (!updated) {
+        return QByteArray();
+    }
+    return QDateTime::fromTime_t(updated).toUTC().toString(Qt::ISODate).toLatin1();
+}
+
+} // end of anonymous namespace
+
+QString viewerSettingsPath() {
+    return appDir().absoluteFilePath("dump_viewer.ini");
+}
+
+// see MainWindow::inputPath
+QString defaultDumpPath(QSettings& settings) {
+    QString path = settings.value("final_txt").toString();
+    if (!path.isEmpty() && QFile(path).exists()) {
+        return path;
+    }
+    QDir dir = appDir();
+    if (QFile(dir.absoluteFilePath("final.txt")).exists()) {
+        return dir.absoluteFilePath("final.txt");
+    }
+    if (QFile(dir.absoluteFilePath("final.txt.gz")).exists()) {
+        return dir.absoluteFilePath("final.txt.gz");
+    }
+    return QString();
+}
+
+QIODevice* newDumpDevice(const QString& path) {
+    if (path.endsWith(".gz")) {
+        return new QuaGzipFile(path);
+    }
+    return new QFile(path);
+}
+
+QByteArray jsonString(const char* data, int size) {
+    QByteArray result;
+    result.reserve(size + 2);
+    result += '"';
+    for (int i = 0; i < size; i++) {
+        unsigned char c = data[i];
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            qsnprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            result += escaped;
+        } else {
+            result += c;
+        }
+    }
+    result += '"';
+    return result;
+}
+
+QByteArray jsonRecord(const ResultStore& results, int row) {
+    QByteArray hash = torrent_hash_string(results.hash(row), false).toLatin1();
+    QByteArray updated = updatedString(results.updated(row));
+    QByteArray record;
+    record += "{\"id\":" + QByteArray::number(results.id(row));
+    record += ",\"name\":" + jsonString(results.nameData(row), results.nameSize(row));
+    record += ",\"size\":" + QByteArray::number(results.torrentSize(row));
+    record += ",\"seeds\":" + QByteArray::number(results.seeds(row));
+    record += ",\"leeches\":" + QByteArray::number(results.leeches(row));
+    record += ",\"hash\":\"" + hash + "\"";
+    record += ",\"downloads\":" + QByteArray::number(results.downloads(row));
+    record += ",\"updated\":" + (updated.isEmpty() ? QByteArray("null") :
+                                                      "\"" + updated + "\"");
+    record += '}';
+    return record;
+}
+
+ResultPrinter::ResultPrinter(FILE* out, Format format):
+    out_(out), format_(format), count_(0) {
+    flushed_.start();
+}
+
+ResultPrinter::~ResultPrinter() {
+    fflush(out_);
+}
+
+void ResultPrinter::printResults(ResultStore_ptr results) {
+    QMutexLocker locker(&mutex_);
+    for (int row = 0; row < results->size(); row++) {
+        printRow(*results, row);
+    }
+    write();
+}
+
+void ResultPrinter::printRow(const ResultStore& results, int row) {
+    if (format_ == TSV) {
+        buffer_ += QByteArray::number(results.id(row));
+        buffer_ += '\t';
+        buffer_ += tsvField(results.nameData(row), results.nameSize(row));
+        buffer_ += '\t';
+        buffer_ += QByteArray::number(results.torrentSize(row));
+        buffer_ += '\t';
+        buffer_ += QByteArray::number(results.seeds(row));
+        buffer_ += '\t';
+        buffer_ += QByteArray::number(results.leeches(row));
+        buffer_ += '\t';
+        buffer_ += torrent_hash_string(results.hash(row), false).toLatin1();
+        buffer_ += '\t';
+        buffer_ += QByteArray::number(results.downloads(row));
+        buffer_ += '\t';
+        buffer_ += updatedString(results.updated(row));
+    } else {
+        // one object per line, so consumers can stream
+        buffer_ += jsonRecord(results, row);
+    }
+    buffer_ += '\n';
+    count_ += 1;
+}
+
+void ResultPrinter::write() {
+    fwrite(buffer_.constData(), 1, buffer_.size(), out_);
+    buffer_.clear();
+    if (flushed_.elapsed() >= FLUSH_MS) {
+        fflush(out_);
+        flushed_.restart();
+    }
+}
+
+bool isConsoleSearch(const QStringList& args) {
+    return args.contains("--query");
+}
+
+int runConsoleSearch(const QStringList& args) {
+    QString pattern = optionValue(args, "--query");
+    QString format = optionValue(args, "--format");
+    QString limit_text = optionValue(args, "--limit");
+    QString sort = optionValue(args, "--sort");
+    int sort_field = SearchQuery::numberField(sort);
+    bool ok = true;
+    int limit = limit_text.isEmpty() ? INT_MAX : limit_text.toInt(&ok);
+    if (pattern.isEmpty() || !ok || limit <= 0 ||
+        (!format.isEmpty() && format != "tsv" && format != "json") ||
+        (!sort.isEmpty() && sort_field < 0)) {
+        usage();
+        return 2;
+    }
+    QSettings settings(viewerSettingsPath(), QSettings::IniFormat);
+    QString path = optionValue(args, "--dump");
+    if (path.isEmpty()) {
+        path = defaultDumpPath(settings);
+    }
+    QScopedPointer<QIODevice> input(newDumpDevice(path));
+    if (path.isEmpty() || !input->open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "can not open database file %s\n", qPrintable(path));
+        return 1;
+    }
+    bool cp1251 = args.contains("--cp1251") || settings.value("cp1251").toBool();
+    // a big buffer, the printer flushes it itself
+    setvbuf(stdout, 0, _IOFBF, 1024 * 1024);
+    ResultPrinter printer(stdout, format == "json" ? ResultPrinter::JSON : ResultPrinter::TSV);
+    // runs here, the scanners print from their own threads
+    SearchingThread thread(input.data(), limit, pattern, cp1251);
+    thread.setAutoDelete(false);
+    if (sort_field >= 0) {
+        thread.setTopBy(sort_field);
+    }
+    QObject::connect(&thread, SIGNAL(newResults(ResultStore_ptr)),
+                     &printer, SLOT(printResults(ResultStore_ptr)),
+                     Qt::DirectConnection);
+    thread.run();
+    fflush(stdout);
+    return 0;
+}
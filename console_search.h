@@ -0,0 +1,75 @@
+#ifndef CONSOLE_SEARCH_H
+#define CONSOLE_SEARCH_H
+
+#include <QtCore>
+#include <cstdio>
+#include "searching_thread.h"
+
+// Headless search for batch jobs:
+//
+//   dump_viewer --query TEXT [--limit N] [--sort FIELD] [--format tsv|json]
+//               [--dump PATH] [--cp1251]
+//
+// The query is the same as in the search box (see search_query.h).
+// Matches go to stdout as soon as the search finds them, one record per
+// line: tab separated fields or JSON objects. With --sort the N matches
+// with the largest id, size, seeds, leeches, downloads or updated come
+// out at the end of the scan instead, largest first. The dump defaults to
+// the one selected in the window.
+
+// dump_viewer.ini next to the binary, shared with the window
+QString viewerSettingsPath();
+
+// the dump selected in the window, empty if there is none
+QString defaultDumpPath(QSettings& settings);
+
+// QFile or QuaGzipFile by the extension, not opened yet
+QIODevice* newDumpDevice(const QString& path);
+
+// UTF-8 JSON string literal
+QByteArray jsonString(const char* data, int size);
+
+// one result row as a JSON object
+QByteArray jsonRecord(const ResultStore& results, int row);
+
+// true if the arguments ask for a headless search
+bool isConsoleSearch(const QStringList& args);
+
+// runs the search to the end, returns the exit code
+int runConsoleSearch(const QStringList& args);
+
+// Writes the results of a search as they come. Chunks are emitted by
+// several scanners at once, so the slots are meant for direct
+// connections and lock.
+class ResultPrinter : public QObject {
+    Q_OBJECT
+public:
+    enum Format {
+        TSV,
+        JSON
+    };
+
+    ResultPrinter(FILE* out, Format format);
+    ~ResultPrinter();
+
+    int count() const {
+        return count_;
+    }
+
+public slots:
+    void printResults(ResultStore_ptr results);
+
+private:
+    FILE* out_;
+    Format format_;
+    QMutex mutex_;
+    int count_;
+    QByteArray buffer_;
+    QElapsedTimer flushed_;
+
+    void printRow(const ResultStore& results, int row);
+    // writes the buffer, flushing stdout now and then for slow searches
+    void write();
+};
+
+#endif // CONSOLE_SEARCH_H
@@ -0,0 +1,287 @@
+#include "description_archive.h"
+#include <climits>
+#include <cstring>
+#include "id_index.h"
+
+namespace {
+
+const quint32 MEMBERS_MAGIC = 0x44564d53; // "DVMS"
+const quint32 MEMBERS_VERSION = 1;
+const int TAR_BLOCK = 512;
+
+bool readFully(GzipIndexReader* reader, char* data, qint64 size) {
+    while (size > 0) {
+        int got = reader->read(data, int(qMin(size, qint64(1024 * 1024))));
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= got;
+    }
+    return true;
+}
+
+qint64 parseOctal(const char* field, int size) {
+    qint64 value = 0;
+    int i = 0;
+    while (i < size && (field[i] == ' ' || field[i] == '\0')) {
+        i++;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+QByteArray headerString(const char* field, int size) {
+    return QByteArray(field, qstrnlen(field, size));
+}
+
+} // end of anonymous namespace
+
+DescriptionArchive::DescriptionArchive(const QString& path):
+    path_(path) {
+}
+
+QString DescriptionArchive::membersPath(const QString& path) {
+    return path + ".members";
+}
+
+bool DescriptionArchive::buildIndex(const QString& path) {
+    DescriptionArchive archive(path);
+    return archive.gz_index_.build(path, INDEX_SPAN) &&
+           archive.gz_index_.save(path) &&
+           archive.scanMembers() &&
+           archive.saveMembers();
+}
+
+bool DescriptionArchive::open() {
+    return gz_index_.load(path_) && loadMembers();
+}
+
+const DescriptionArchive::Member* DescriptionArchive::find(int id) const {
+    Member key;
+    key.id = id;
+    QVector<Member>::const_iterator it = qLowerBound(members_.begin(), members_.end(), key);
+    if (it == members_.end() || it->id != id) {
+        return 0;
+    }
+    return &*it;
+}
+
+bool DescriptionArchive::contains(int id) const {
+    return find(id) != 0;
+}
+
+qint64 DescriptionArchive::memberOffset(int id) const {
+    const Member* member = find(id);
+    return member ? member->offset : -1;
+}
+
+QList<int> DescriptionArchive::ids() const {
+    QList<int> result;
+    foreach (const Member& member, members_) {
+        result << member.id;
+    }
+    return result;
+}
+
+QByteArray DescriptionArchive::read(int id) const {
+    const Member* member = find(id);
+    if (!member) {
+        return QByteArray();
+    }
+    GzipIndexReader reader(path_, &gz_index_);
+    QByteArray data(member->length, 0);
+    if (!reader.seek(member->offset) || !readFully(&reader, data.data(), data.size())) {
+        qDebug() << "can not read" << id << "from" << path_;
+        return QByteArray();
+    }
+    return data;
+}
+
+bool DescriptionArchive::readAll(QMap<int, QByteArray>* files) const {
+    // in tar order, so the reader only moves forward
+    QVector<Member> members = members_;
+    qSort(members.begin(), members.end(), Member::offsetLess);
+    GzipIndexReader reader(path_, &gz_index_);
+    foreach (const Member& member, members) {
+        QByteArray data(member.length, 0);
+        if (!reader.seek(member.offset) || !readFully(&reader, data.data(), data.size())) {
+            qDebug() << "can not read" << member.id << "from" << path_;
+            return false;
+        }
+        files->insert(member.id, data);
+    }
+    return true;
+}
+
+// Walks the tar headers; files are skipped through the gzip index.
+bool DescriptionArchive::scanMembers() {
+    members_.clear();
+    GzipIndexReader reader(path_, &gz_index_);
+    qint64 pos = 0;
+    QByteArray long_name;
+    char header[TAR_BLOCK];
+    while (reader.seek(pos) && readFully(&reader, header, TAR_BLOCK)) {
+        bool zero = true;
+        for (int i = 0; i < TAR_BLOCK && zero; i++) {
+            zero = header[i] == '\0';
+        }
+        if (zero) {
+            break; // end of archive
+        }
+        qint64 size = parseOctal(header + 124, 12);
+        char type = header[156];
+        QByteArray name;
+        if (!long_name.isEmpty()) {
+            name = long_name;
+            long_name.clear();
+        } else {
+            name = headerString(header, 100);
+            QByteArray prefix = headerString(header + 345, 155);
+            if (memcmp(header + 257, "ustar", 5) == 0 && !prefix.isEmpty()) {
+                name = prefix + "/" + name;
+            }
+        }
+        qint64 data = pos + TAR_BLOCK;
+        if (type == 'L') {
+            // GNU long name of the next member
+            long_name.resize(int(size));
+            if (!readFully(&reader, long_name.data(), size)) {
+                return false;
+            }
+            long_name = headerString(long_name.constData(), long_name.size());
+        } else if ((type == '0' || type == '\0') && size <= INT_MAX) {
+            bool ok;
+            int id = name.mid(name.lastIndexOf('/') + 1).toInt(&ok);
+            if (ok) {
+                Member member;
+                member.id = id;
+                member.offset = data;
+                member.length = int(size);
+                members_ << member;
+            }
+        }
+        pos = data + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+    }
+    qSort(members_);
+    return !members_.isEmpty();
+}
+
+bool DescriptionArchive::saveMembers() const {
+    QFileInfo info(path_);
+    QString members_path = membersPath(path_);
+    QString tmp_path = members_path + ".tmp";
+    QFile file(tmp_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write member list" << tmp_path;
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << MEMBERS_MAGIC << MEMBERS_VERSION
+        << qint64(info.size()) << qint64(info.lastModified().toTime_t())
+        << qint32(members_.size());
+    foreach (const Member& member, members_) {
+        out << member.id << member.offset << member.length;
+    }
+    bool ok = out.status() == QDataStream::Ok;
+    file.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(members_path);
+    return QFile::rename(tmp_path, members_path);
+}
+
+bool DescriptionArchive::loadMembers() {
+    members_.clear();
+    QFileInfo info(path_);
+    QFile file(membersPath(path_));
+    if (!info.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+    quint32 magic, version;
+    qint64 size, mtime;
+    qint32 count;
+    in >> magic >> version >> size >> mtime >> count;
+    if (in.status() != QDataStream::Ok || magic != MEMBERS_MAGIC ||
+        version != MEMBERS_VERSION || size != info.size() ||
+        mtime != qint64(info.lastModified().toTime_t()) || count < 0) {
+        qDebug() << "stale or broken member list" << file.fileName();
+        return false;
+    }
+    members_.resize(count);
+    for (int i = 0; i < count; i++) {
+        Member& member = members_[i];
+        in >> member.id >> member.offset >> member.length;
+    }
+    if (in.status() != QDataStream::Ok) {
+        members_.clear();
+        return false;
+    }
+    return true;
+}
+
+DescriptionIndexingThread::DescriptionIndexingThread(QString root):
+    root_(root) {
+}
+
+QStringList DescriptionIndexingThread::listArchives(const QString& root, qint64* latest_mtime) {
+    QStringList paths;
+    *latest_mtime = 0;
+    QDirIterator it(root, QStringList() << "*.tar.gz" << "*.tar.gz.gz", QDir::Files,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        paths << it.next();
+        *latest_mtime = qMax(*latest_mtime, qint64(it.fileInfo().lastModified().toTime_t()));
+    }
+    return paths;
+}
+
+bool DescriptionIndexingThread::openIds(const QString& root, IdIndex* ids) {
+    qint64 latest_mtime;
+    int count = listArchives(root, &latest_mtime).size();
+    return count > 0 && ids->open(IdIndex::descriptionsIndexPath(root), count, latest_mtime);
+}
+
+void DescriptionIndexingThread::run() {
+    qint64 latest_mtime;
+    QStringList all = listArchives(root_, &latest_mtime);
+    QStringList archives;
+    // archives packed twice (.tar.gz.gz) are not indexed
+    bool complete = true;
+    foreach (const QString& path, all) {
+        if (path.endsWith(".tar.gz")) {
+            archives << path;
+        } else {
+            complete = false;
+        }
+    }
+    bool ok = !archives.isEmpty();
+    IdIndexBuilder ids;
+    for (int i = 0; i < archives.size(); i++) {
+        const QString& path = archives[i];
+        // fresh indexes are kept, so new archives are cheap to add
+        DescriptionArchive archive(path);
+        if (archive.open() || (DescriptionArchive::buildIndex(path) && archive.open())) {
+            foreach (int id, archive.ids()) {
+                ids.add(id, archive.memberOffset(id));
+            }
+        } else {
+            qDebug() << "can not index" << path;
+            ok = false;
+        }
+        emit progress(i + 1, archives.size());
+    }
+    // the table tells misses only if it knows every topic
+    QString ids_path = IdIndex::descriptionsIndexPath(root_);
+    if (!ok || !complete || !ids.save(ids_path, all.size(), latest_mtime)) {
+        QFile::remove(ids_path);
+    }
+    emit finished(ok);
+}
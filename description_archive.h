@@ -0,0 +1,93 @@
+#ifndef DESCRIPTION_ARCHIVE_H
+#define DESCRIPTION_ARCHIVE_H
+
+#include <QtCore>
+#include "gzip_index.h"
+
+class IdIndex;
+
+// One archive of the descriptions database (XXX/XXXXX.tar.gz), which
+// holds the descriptions of up to 1000 topics as tar members named by the
+// 8 digit topic id.
+//
+// Once indexed, a description is read without touching the rest of the
+// archive: the member list (XXXXX.tar.gz.members) maps the topic id to
+// the offset and length of its file in the uncompressed tar, and a dense
+// gzip index (XXXXX.tar.gz.zidx) lets inflating start close before it.
+
+class DescriptionArchive {
+public:
+    enum {
+        // short spans keep the bytes inflated per description low
+        INDEX_SPAN = 256 * 1024
+    };
+
+    DescriptionArchive(const QString& path);
+
+    static QString membersPath(const QString& path);
+
+    // inflates the archive once and writes both index files
+    static bool buildIndex(const QString& path);
+
+    // loads both index files; fails if they are missing or stale
+    bool open();
+
+    bool contains(int id) const;
+    QList<int> ids() const;
+    // offset of the file of the topic in the uncompressed tar, -1 if none
+    qint64 memberOffset(int id) const;
+
+    // contents of the file of the topic, empty if it is not in the archive
+    QByteArray read(int id) const;
+
+    // contents of all files by topic id, inflating the archive once
+    bool readAll(QMap<int, QByteArray>* files) const;
+
+private:
+    struct Member {
+        qint32 id;
+        qint64 offset; // in the uncompressed tar
+        qint32 length;
+
+        bool operator<(const Member& other) const {
+            return id < other.id;
+        }
+
+        static bool offsetLess(const Member& a, const Member& b) {
+            return a.offset < b.offset;
+        }
+    };
+
+    QString path_;
+    GzipIndex gz_index_;
+    QVector<Member> members_; // sorted by id
+
+    const Member* find(int id) const;
+    bool scanMembers();
+    bool saveMembers() const;
+    bool loadMembers();
+};
+
+// Indexes every archive under the descriptions root and writes the id
+// table of all topics with descriptions (descriptions.ids). The table is
+// stamped with the number of archives and the latest of their mtimes, so
+// an archive added or replaced later makes it stale.
+class DescriptionIndexingThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    DescriptionIndexingThread(QString root);
+    void run();
+
+    // opens descriptions.ids of root; fails if it is missing or stale
+    static bool openIds(const QString& root, IdIndex* ids);
+signals:
+    void progress(int done, int total);
+    void finished(bool ok);
+private:
+    QString root_;
+
+    // archives under root, the ones packed twice (.tar.gz.gz) included
+    static QStringList listArchives(const QString& root, qint64* latest_mtime);
+};
+
+#endif // DESCRIPTION_ARCHIVE_H
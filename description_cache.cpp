@@ -0,0 +1,69 @@
+#include "description_cache.h"
+#include <climits>
+
+namespace {
+
+QString descriptionKey(int id) {
+    return "id:" + QString::number(id);
+}
+
+QString tarKey(const QString& bucket) {
+    return "tar:" + bucket;
+}
+
+} // end of anonymous namespace
+
+DescriptionCache::DescriptionCache(int budget_mb) {
+    setBudget(budget_mb);
+}
+
+void DescriptionCache::setBudget(int budget_mb) {
+    QMutexLocker locker(&mutex_);
+    entries_.setMaxCost(qMax(budget_mb, 1) * 1024);
+}
+
+void DescriptionCache::clear() {
+    QMutexLocker locker(&mutex_);
+    entries_.clear();
+}
+
+bool DescriptionCache::description(int id, QString* description) {
+    QMutexLocker locker(&mutex_);
+    Entry* entry = entries_.object(descriptionKey(id));
+    if (!entry) {
+        return false;
+    }
+    *description = entry->description;
+    return true;
+}
+
+void DescriptionCache::insertDescription(int id, const QString& description) {
+    if (description.isEmpty()) {
+        return;
+    }
+    Entry* entry = new Entry;
+    entry->description = description;
+    insert(descriptionKey(id), entry, description.size() * sizeof(QChar));
+}
+
+bool DescriptionCache::tar(const QString& bucket, QByteArray* tar) {
+    QMutexLocker locker(&mutex_);
+    Entry* entry = entries_.object(tarKey(bucket));
+    if (!entry) {
+        return false;
+    }
+    *tar = entry->tar;
+    return true;
+}
+
+void DescriptionCache::insertTar(const QString& bucket, const QByteArray& tar) {
+    Entry* entry = new Entry;
+    entry->tar = tar;
+    insert(tarKey(bucket), entry, tar.size());
+}
+
+void DescriptionCache::insert(const QString& key, Entry* entry, qint64 bytes) {
+    QMutexLocker locker(&mutex_);
+    // entries larger than the whole budget are deleted by QCache
+    entries_.insert(key, entry, int(qMin(bytes / 1024 + 1, qint64(INT_MAX))));
+}
@@ -0,0 +1,48 @@
+#ifndef DESCRIPTION_CACHE_H
+#define DESCRIPTION_CACHE_H
+
+#include <QtCore>
+
+// LRU cache of the descriptions database with one memory budget.
+//
+// It holds final description strings (by topic id) and whole inflated
+// tar archives (by bucket, the first 5 digits of the padded id) of
+// archives that have no index, so stepping through neighbouring topics
+// inflates every archive once. Both kinds share the budget and are
+// evicted least recently used first. All methods are thread safe.
+
+class DescriptionCache {
+public:
+    enum {
+        DEFAULT_BUDGET_MB = 64
+    };
+
+    DescriptionCache(int budget_mb = DEFAULT_BUDGET_MB);
+
+    void setBudget(int budget_mb);
+    void clear();
+
+    bool description(int id, QString* description);
+    // an empty description is a failed load and is not kept, so the next
+    // lookup tries again
+    void insertDescription(int id, const QString& description);
+
+    bool tar(const QString& bucket, QByteArray* tar);
+    void insertTar(const QString& bucket, const QByteArray& tar);
+
+private:
+    Q_DISABLE_COPY(DescriptionCache)
+
+    struct Entry {
+        QString description;
+        QByteArray tar;
+    };
+
+    QMutex mutex_;
+    // costs are in kilobytes to fit large budgets into int
+    QCache<QString, Entry> entries_;
+
+    void insert(const QString& key, Entry* entry, qint64 bytes);
+};
+
+#endif // DESCRIPTION_CACHE_H
@@ -0,0 +1,186 @@
+#include "description_loader.h"
+#include <zlib.h>
+#include "Archive.h"
+#include "ArchiveImpl.h"
+#include "description_archive.h"
+#include "description_cache.h"
+#include "description_store.h"
+
+namespace {
+
+QByteArray gUncompress(const QByteArray &data)
+{
+    if(data.size()<=4){
+        qWarning("gUncompress: Input data is truncated");
+        return QByteArray();
+    }
+    QByteArray result;
+
+    int ret;
+    z_stream strm;
+    static const int CHUNK_SIZE = 1024;
+    char out[CHUNK_SIZE];
+
+    /* allocate inflate state */
+    strm.zalloc=Z_NULL;
+    strm.zfree=Z_NULL;
+    strm.opaque=Z_NULL;
+    strm.avail_in=data.size();
+    strm.next_in=(Bytef*)(data.data());
+
+    ret=inflateInit2(&strm,15+32); // gzip decoding
+    if(ret!=Z_OK)
+        return QByteArray();
+
+    // run inflate()
+    do{
+        strm.avail_out=CHUNK_SIZE;
+        strm.next_out=(Bytef*)(out);
+
+        ret=inflate(&strm, Z_NO_FLUSH);
+        Q_ASSERT(ret!=Z_STREAM_ERROR);  // state not clobbered
+
+        switch(ret){
+            case Z_NEED_DICT:
+                ret = Z_DATA_ERROR;     // and fall through
+            case Z_DATA_ERROR:
+            case Z_MEM_ERROR:
+                (void)inflateEnd(&strm);
+                return QByteArray();
+        }
+        result.append(out,CHUNK_SIZE-strm.avail_out);
+    } while(strm.avail_out==0);
+
+    // clean up and return
+    inflateEnd(&strm);
+    return result;
+}
+
+bool superseded(const QAtomicInt* generation, int request) {
+    return generation && int(*generation) != request;
+}
+
+QString padId(int id) {
+    return QString("%1").arg(id, /*width*/ int(8), /*base*/ int(10), QChar('0'));
+}
+
+} // end of anonymous namespace
+
+QString descriptionBucket(int id) {
+    return padId(id).left(5);
+}
+
+QString descriptionArchivePath(const QString& root, int id) {
+    QDir dir0(root);
+    QString id_c = padId(id);
+    QString dir = id_c.left(3);
+    dir0.cd(dir);
+    QString tar = id_c.left(5) + ".tar.gz";
+    QString tar_abs = dir0.absoluteFilePath(tar);
+    if (!QFile(tar_abs).exists()) {
+        tar_abs += ".gz";
+        if (!QFile(tar_abs).exists()) {
+            qDebug() << "!QFile(tar_abs).exists()" << tar_abs;
+            return "";
+        }
+    }
+    return tar_abs;
+}
+
+QString loadDescription(const DescriptionSource& source, int id,
+                        const QAtomicInt* generation, int request) {
+    DescriptionCache* cache = source.cache;
+    QString description;
+    if (cache->description(id, &description)) {
+        return description;
+    }
+    if (source.store && source.store->contains(id)) {
+        description = QString::fromUtf8(source.store->read(id));
+        cache->insertDescription(id, description);
+        return description;
+    }
+    if (source.ids && !source.ids->contains(id)) {
+        return "";
+    }
+    QString tar_abs = descriptionArchivePath(source.root, id);
+    if (tar_abs.isEmpty() || superseded(generation, request)) {
+        return "";
+    }
+    qDebug() << tar_abs;
+    // indexed archives give out single members
+    DescriptionArchive archive(tar_abs);
+    if (archive.open()) {
+        description = QString::fromUtf8(archive.read(id));
+        cache->insertDescription(id, description);
+        return description;
+    }
+    QString id_c = padId(id);
+    QString bucket = descriptionBucket(id);
+    QByteArray tar_ba;
+    if (!cache->tar(bucket, &tar_ba)) {
+        QFile tar_gz_file(tar_abs);
+        if(!tar_gz_file.open(QIODevice::ReadOnly)){
+            qDebug()<<"!tar_gz_file.open"; return "";
+        }
+        QByteArray tar_gz_ba=tar_gz_file.readAll(); // _ba means QByteArray, _file means QFile
+        tar_gz_file.close();
+        if (superseded(generation, request)) {
+            return "";
+        }
+        tar_ba=gUncompress(tar_gz_ba);
+        // a broken archive is not kept, neighbouring topics try it again
+        if (tar_ba.isEmpty()) {
+            qDebug() << "can not inflate" << tar_abs;
+            return "";
+        }
+        cache->insertTar(bucket, tar_ba);
+    }
+    if (superseded(generation, request)) {
+        return "";
+    }
+    QBuffer tar_buf; tar_buf.open(QIODevice::ReadWrite); tar_buf.write(tar_ba); tar_buf.close();
+    bugless::Archive tar_ar(&tar_buf,(bugless::Archive::Type)2);
+    if(!tar_ar.valid()){
+        qDebug()<<"tar archive turned invalid!"; return "";
+    }
+    QIODevice* desc_dev;
+    if((desc_dev=tar_ar.device(id_c))==NULL){
+        qDebug()<<"somehow failed to extract description file from tar archive"; return "";
+    }
+    desc_dev->open(QIODevice::ReadOnly);
+    description=QString::fromUtf8(desc_dev->readAll());
+    desc_dev->close();
+    cache->insertDescription(id, description);
+    return description;
+}
+
+DescriptionThread::DescriptionThread(DescriptionSource source, int id,
+                                     const QAtomicInt* generation, int request):
+    source_(source), id_(id), generation_(generation), request_(request) {
+}
+
+void DescriptionThread::run() {
+    if (superseded(generation_, request_)) {
+        return;
+    }
+    QString description = loadDescription(source_, id_, generation_, request_);
+    if (!superseded(generation_, request_)) {
+        emit loaded(id_, description);
+    }
+}
+
+DescriptionPrefetchThread::DescriptionPrefetchThread(DescriptionSource source,
+                                                     QList<int> ids,
+                                                     const QAtomicInt* generation,
+                                                     int request):
+    source_(source), ids_(ids), generation_(generation), request_(request) {
+}
+
+void DescriptionPrefetchThread::run() {
+    foreach (int id, ids_) {
+        if (superseded(generation_, request_)) {
+            return;
+        }
+        loadDescription(source_, id, generation_, request_);
+    }
+}
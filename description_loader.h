@@ -0,0 +1,65 @@
+#ifndef DESCRIPTION_LOADER_H
+#define DESCRIPTION_LOADER_H
+
+#include <QtCore>
+#include "id_index.h"
+
+class DescriptionCache;
+class DescriptionStore;
+typedef QSharedPointer<DescriptionStore> DescriptionStore_ptr;
+
+// Where descriptions come from. The packed store, if any, is tried
+// before the archives under root, and the id table of the root, if any,
+// answers misses without touching the archives. Both are shared with the
+// jobs so replacing them never pulls a mapping from under a running fetch.
+struct DescriptionSource {
+    QString root;
+    DescriptionCache* cache;
+    DescriptionStore_ptr store;
+    IdIndex_ptr ids;
+};
+
+// first 5 digits of the 8 digit topic id, names the archive of the topic
+QString descriptionBucket(int id);
+
+// archive of the descriptions database holding the topic
+// (root/XXX/XXXXX.tar.gz or .tar.gz.gz), empty if there is none
+QString descriptionArchivePath(const QString& root, int id);
+
+// description of the topic, through the cache. If generation is given,
+// loading stops with an empty result once it moves away from request.
+QString loadDescription(const DescriptionSource& source, int id,
+                        const QAtomicInt* generation = 0, int request = 0);
+
+// Loads one description in a pool thread. A newer selection bumps the
+// generation, which cancels this fetch and drops its result.
+class DescriptionThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    DescriptionThread(DescriptionSource source, int id,
+                      const QAtomicInt* generation, int request);
+    void run();
+signals:
+    void loaded(int id, QString description);
+private:
+    DescriptionSource source_;
+    int id_;
+    const QAtomicInt* generation_;
+    int request_;
+};
+
+// Fills the cache with descriptions of one bucket ahead of the user.
+// Stops when the generation moves away from request.
+class DescriptionPrefetchThread : public QRunnable {
+public:
+    DescriptionPrefetchThread(DescriptionSource source, QList<int> ids,
+                              const QAtomicInt* generation, int request);
+    void run();
+private:
+    DescriptionSource source_;
+    QList<int> ids_;
+    const QAtomicInt* generation_;
+    int request_;
+};
+
+#endif // DESCRIPTION_LOADER_H
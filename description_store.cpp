@@ -0,0 +1,366 @@
+#include "description_store.h"
+#include <algorithm>
+#include <climits>
+#include "gzip/gzip.h"
+#include "description_archive.h"
+
+namespace {
+
+const char STORE_MAGIC[8] = {'D', 'V', 'D', 'E', 'S', 'C', '0', '2'};
+
+// pieces of markup used to train the dictionary
+const int MIN_PIECE = 8;
+const int MAX_PIECE = 256;
+
+struct StoreTrailer {
+    qint64 dictionary_pos;
+    qint64 dictionary_size;
+    qint64 table_pos;
+    quint64 count;
+    char magic[8];
+};
+
+bool openArchive(DescriptionArchive* archive, const QString& path) {
+    if (archive->open() || (DescriptionArchive::buildIndex(path) && archive->open())) {
+        return true;
+    }
+    qDebug() << "can not index" << path;
+    return false;
+}
+
+bool morePieceScore(const QPair<qint64, QByteArray>& a,
+                    const QPair<qint64, QByteArray>& b) {
+    return a.first > b.first;
+}
+
+} // end of anonymous namespace
+
+struct DescriptionStore::Entry {
+    qint64 offset;
+    qint32 id;
+    quint32 size;
+
+    bool operator<(const Entry& other) const {
+        return id < other.id;
+    }
+};
+
+DescriptionStore::DescriptionStore():
+    map_(0), table_pos_(0), count_(0), table_(0) {
+}
+
+DescriptionStore::~DescriptionStore() {
+    close();
+}
+
+QString DescriptionStore::storePath(const QString& root) {
+    return QDir(root).absoluteFilePath("descriptions.store");
+}
+
+bool DescriptionStore::open(const QString& path) {
+    close();
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file_.size();
+    if (size < qint64(sizeof(STORE_MAGIC) + sizeof(StoreTrailer))) {
+        file_.close();
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (!map_) {
+        file_.close();
+        return false;
+    }
+    const StoreTrailer* trailer =
+        reinterpret_cast<const StoreTrailer*>(map_ + size - sizeof(StoreTrailer));
+    qint64 table_end = size - sizeof(StoreTrailer);
+    bool valid = memcmp(map_, STORE_MAGIC, sizeof(STORE_MAGIC)) == 0 &&
+                 memcmp(trailer->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) == 0 &&
+                 trailer->count < quint64(INT_MAX) &&
+                 trailer->table_pos >= qint64(sizeof(STORE_MAGIC)) &&
+                 trailer->table_pos % sizeof(qint64) == 0 &&
+                 table_end - trailer->table_pos == qint64(trailer->count * sizeof(Entry)) &&
+                 trailer->dictionary_pos == qint64(sizeof(STORE_MAGIC)) &&
+                 trailer->dictionary_size >= 0 &&
+                 trailer->dictionary_size <= trailer->table_pos - trailer->dictionary_pos;
+    if (!valid) {
+        qDebug() << "broken description store" << path;
+        close();
+        return false;
+    }
+    table_pos_ = trailer->table_pos;
+    count_ = trailer->count;
+    table_ = reinterpret_cast<const Entry*>(map_ + table_pos_);
+    dictionary_ = QByteArray::fromRawData(
+            reinterpret_cast<const char*>(map_ + trailer->dictionary_pos),
+            trailer->dictionary_size);
+    return true;
+}
+
+void DescriptionStore::close() {
+    if (map_) {
+        file_.unmap(map_);
+        map_ = 0;
+    }
+    if (file_.isOpen()) {
+        file_.close();
+    }
+    table_pos_ = 0;
+    count_ = 0;
+    table_ = 0;
+    dictionary_.clear();
+}
+
+const DescriptionStore::Entry* DescriptionStore::find(int id) const {
+    Entry key;
+    key.id = id;
+    const Entry* entry = std::lower_bound(table_, table_ + count_, key);
+    if (entry == table_ + count_ || entry->id != id) {
+        return 0;
+    }
+    return entry;
+}
+
+bool DescriptionStore::contains(int id) const {
+    return find(id) != 0;
+}
+
+QByteArray DescriptionStore::read(int id) const {
+    const Entry* entry = find(id);
+    if (!entry || entry->offset + entry->size > table_pos_) {
+        return QByteArray();
+    }
+    QByteArray record = QByteArray::fromRawData(
+            reinterpret_cast<const char*>(map_ + entry->offset), entry->size);
+    if (dictionary_.isEmpty()) {
+        return bugless::gzip::uncompress(record);
+    }
+    return bugless::gzip::uncompress(record, dictionary_);
+}
+
+QByteArray DescriptionStore::trainDictionary(const QList<QByteArray>& samples,
+                                             int max_size) {
+    // pieces end at tags and lines; counted once per sample
+    QHash<QByteArray, int> counts;
+    foreach (const QByteArray& sample, samples) {
+        QSet<QByteArray> seen;
+        int start = 0;
+        for (int i = 0; i < sample.size(); i++) {
+            char c = sample[i];
+            if (c != '>' && c != '\n' && i + 1 - start < MAX_PIECE) {
+                continue;
+            }
+            QByteArray piece = sample.mid(start, i + 1 - start);
+            start = i + 1;
+            if (piece.size() >= MIN_PIECE && !seen.contains(piece)) {
+                seen.insert(piece);
+                counts[piece] += 1;
+            }
+        }
+    }
+    QList<QPair<qint64, QByteArray> > pieces;
+    for (QHash<QByteArray, int>::const_iterator it = counts.constBegin();
+            it != counts.constEnd(); ++it) {
+        if (it.value() > 1) {
+            // bytes saved over all samples
+            pieces << qMakePair(qint64(it.value() - 1) * it.key().size(), it.key());
+        }
+    }
+    qSort(pieces.begin(), pieces.end(), morePieceScore);
+    QList<QByteArray> chosen;
+    int size = 0;
+    for (int i = 0; i < pieces.size(); i++) {
+        const QByteArray& piece = pieces[i].second;
+        if (size + piece.size() <= max_size) {
+            chosen.prepend(piece);
+            size += piece.size();
+        }
+    }
+    QByteArray dictionary;
+    dictionary.reserve(size);
+    foreach (const QByteArray& piece, chosen) {
+        dictionary += piece;
+    }
+    return dictionary;
+}
+
+DescriptionStoreWriter::DescriptionStoreWriter():
+    dictionary_pos_(sizeof(STORE_MAGIC)) {
+}
+
+bool DescriptionStoreWriter::open(const QString& path) {
+    records_.clear();
+    dictionary_.clear();
+    qint64 records_end = sizeof(STORE_MAGIC);
+    {
+        DescriptionStore store;
+        if (store.open(path)) {
+            for (int i = 0; i < store.count_; i++) {
+                Record record;
+                record.offset = store.table_[i].offset;
+                record.size = store.table_[i].size;
+                records_[store.table_[i].id] = record;
+            }
+            records_end = store.table_pos_;
+            // a deep copy, the store is unmapped
+            dictionary_ = QByteArray(store.dictionary_.constData(), store.dictionary_.size());
+        }
+    }
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::ReadWrite)) {
+        qDebug() << "can not write description store" << path;
+        return false;
+    }
+    if (records_.isEmpty()) {
+        // a new store or a broken one, which is started over
+        records_end = sizeof(STORE_MAGIC);
+        dictionary_.clear();
+        file_.resize(0);
+        if (file_.write(STORE_MAGIC, sizeof(STORE_MAGIC)) != sizeof(STORE_MAGIC)) {
+            file_.close();
+            return false;
+        }
+    }
+    // the old table is overwritten by new records
+    return file_.resize(records_end) && file_.seek(records_end);
+}
+
+bool DescriptionStoreWriter::isEmpty() const {
+    return records_.isEmpty();
+}
+
+bool DescriptionStoreWriter::setDictionary(const QByteArray& dictionary) {
+    if (!records_.isEmpty() || file_.pos() != dictionary_pos_) {
+        return false;
+    }
+    if (file_.write(dictionary) != dictionary.size()) {
+        return false;
+    }
+    dictionary_ = dictionary;
+    return true;
+}
+
+bool DescriptionStoreWriter::contains(int id) const {
+    return records_.contains(id);
+}
+
+bool DescriptionStoreWriter::add(int id, const QByteArray& description) {
+    QByteArray compressed = dictionary_.isEmpty() ?
+                            bugless::gzip::compress(description) :
+                            bugless::gzip::compress(description, dictionary_);
+    Record record;
+    record.offset = file_.pos();
+    record.size = compressed.size();
+    if (file_.write(compressed) != compressed.size()) {
+        return false;
+    }
+    records_[id] = record;
+    return true;
+}
+
+bool DescriptionStoreWriter::close() {
+    QVector<DescriptionStore::Entry> table;
+    table.reserve(records_.size());
+    for (QHash<int, Record>::const_iterator it = records_.constBegin();
+            it != records_.constEnd(); ++it) {
+        DescriptionStore::Entry entry;
+        entry.offset = it.value().offset;
+        entry.id = it.key();
+        entry.size = it.value().size;
+        table << entry;
+    }
+    qSort(table);
+    StoreTrailer trailer;
+    // the table is aligned for reading it in place
+    int padding = (sizeof(qint64) - file_.pos() % sizeof(qint64)) % sizeof(qint64);
+    bool ok = file_.write(QByteArray(padding, '\0')) == padding;
+    trailer.dictionary_pos = dictionary_pos_;
+    trailer.dictionary_size = dictionary_.size();
+    trailer.table_pos = file_.pos();
+    trailer.count = table.size();
+    memcpy(trailer.magic, STORE_MAGIC, sizeof(trailer.magic));
+    qint64 table_bytes = table.size() * sizeof(DescriptionStore::Entry);
+    ok = ok && file_.write((const char*)table.constData(), table_bytes) == table_bytes;
+    ok = ok && file_.write((const char*)&trailer, sizeof(trailer)) == sizeof(trailer);
+    file_.close();
+    return ok;
+}
+
+DescriptionPackingThread::DescriptionPackingThread(QString root, bool dictionary):
+    root_(root), dictionary_(dictionary) {
+}
+
+QByteArray DescriptionPackingThread::sampleDictionary(const QStringList& archives) {
+    QList<QByteArray> samples;
+    int bytes = 0;
+    // archives spread over the whole id range
+    int step = qMax(archives.size() / int(SAMPLE_ARCHIVES), 1);
+    for (int i = 0; i < archives.size() && bytes < SAMPLE_BYTES; i += step) {
+        DescriptionArchive archive(archives[i]);
+        QMap<int, QByteArray> files;
+        if (!openArchive(&archive, archives[i]) || !archive.readAll(&files)) {
+            continue;
+        }
+        foreach (const QByteArray& file, files) {
+            samples << file;
+            bytes += file.size();
+            if (bytes >= SAMPLE_BYTES) {
+                break;
+            }
+        }
+    }
+    return DescriptionStore::trainDictionary(samples);
+}
+
+void DescriptionPackingThread::run() {
+    QStringList archives;
+    QDirIterator it(root_, QStringList() << "*.tar.gz", QDir::Files,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        archives << it.next();
+    }
+    archives.sort();
+    DescriptionStoreWriter writer;
+    if (archives.isEmpty() || !writer.open(DescriptionStore::storePath(root_))) {
+        emit finished(false);
+        return;
+    }
+    if (dictionary_ && writer.isEmpty() && !writer.setDictionary(sampleDictionary(archives))) {
+        writer.close();
+        emit finished(false);
+        return;
+    }
+    bool ok = true;
+    int broken = 0;
+    for (int i = 0; i < archives.size() && ok; i++) {
+        const QString& path = archives[i];
+        DescriptionArchive archive(path);
+        if (!openArchive(&archive, path)) {
+            broken += 1;
+            emit progress(i + 1, archives.size());
+            continue;
+        }
+        bool packed = true;
+        foreach (int id, archive.ids()) {
+            packed = packed && writer.contains(id);
+        }
+        QMap<int, QByteArray> files;
+        if (!packed && !archive.readAll(&files)) {
+            qDebug() << "can not read" << path;
+            broken += 1;
+            files.clear();
+        }
+        for (QMap<int, QByteArray>::const_iterator file = files.constBegin();
+                file != files.constEnd() && ok; ++file) {
+            ok = writer.add(file.key(), file.value());
+        }
+        emit progress(i + 1, archives.size());
+    }
+    if (broken > 0) {
+        qDebug() << broken << "archives are not packed";
+    }
+    ok = writer.close() && ok;
+    emit finished(ok && broken == 0);
+}
@@ -0,0 +1,125 @@
+#ifndef DESCRIPTION_STORE_H
+#define DESCRIPTION_STORE_H
+
+#include <QtCore>
+
+// All descriptions in one file (descriptions.store in the descriptions
+// root), packed from the XXX/XXXXX.tar.gz archives.
+//
+// Every description is compressed on its own, so any one of them is
+// inflated alone. Records are only appended; the table of records sorted
+// by topic id follows them and a fixed size trailer ends the file:
+//
+//   magic | dictionary | records... | table (id, size, offset) | trailer
+//
+// Descriptions are short and alike, so a store may have a preset deflate
+// dictionary trained on a sample of them; its records are then zlib
+// streams against it (bugless::gzip with a dictionary), otherwise gzip
+// members. The dictionary is chosen when the store is created.
+// The reader maps the file and reads records and table in place.
+
+class DescriptionStore {
+public:
+    enum {
+        // deflate can not look further back
+        DICTIONARY_SIZE = 32 * 1024
+    };
+
+    DescriptionStore();
+    ~DescriptionStore();
+
+    static QString storePath(const QString& root);
+
+    // maps the store; fails if it is missing or broken
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const {
+        return map_ != 0;
+    }
+
+    int size() const {
+        return count_;
+    }
+
+    bool contains(int id) const;
+
+    // description of the topic, empty if it is not in the store.
+    // Thread safe.
+    QByteArray read(int id) const;
+
+    // pieces of markup found in many of the samples, most common last
+    static QByteArray trainDictionary(const QList<QByteArray>& samples,
+                                      int max_size = DICTIONARY_SIZE);
+
+private:
+    Q_DISABLE_COPY(DescriptionStore)
+
+    struct Entry;
+
+    QFile file_;
+    uchar* map_;
+    qint64 table_pos_;
+    int count_;
+    const Entry* table_;
+    QByteArray dictionary_; // raw data in the mapping
+
+    const Entry* find(int id) const;
+
+    friend class DescriptionStoreWriter;
+};
+
+// Appends descriptions to a store, keeping the records already there.
+class DescriptionStoreWriter {
+public:
+    DescriptionStoreWriter();
+
+    bool open(const QString& path);
+    // true until the first description of a new store is added
+    bool isEmpty() const;
+    // only before the first description of a new store
+    bool setDictionary(const QByteArray& dictionary);
+    bool contains(int id) const;
+    // a description already in the store is replaced
+    bool add(int id, const QByteArray& description);
+    // writes the table and the trailer
+    bool close();
+
+private:
+    struct Record {
+        qint64 offset;
+        quint32 size;
+    };
+
+    QFile file_;
+    QHash<int, Record> records_;
+    qint64 dictionary_pos_;
+    QByteArray dictionary_;
+};
+
+// Packs every archive under the descriptions root into the store.
+// Archives whose topics are all in the store already are skipped.
+// Broken archives do not stop the others, but the packing then reports
+// failure, since their topics are missing from the store.
+// A new store gets a dictionary trained on a sample of the archives
+// if dictionary is set.
+class DescriptionPackingThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    enum {
+        SAMPLE_ARCHIVES = 16,
+        SAMPLE_BYTES = 8 * 1024 * 1024
+    };
+
+    DescriptionPackingThread(QString root, bool dictionary);
+    void run();
+signals:
+    void progress(int done, int total);
+    void finished(bool ok);
+private:
+    QString root_;
+    bool dictionary_;
+
+    QByteArray sampleDictionary(const QStringList& archives);
+};
+
+#endif // DESCRIPTION_STORE_H
@@ -0,0 +1,90 @@
+#include "dump_indexer.h"
+#include "gzip_index.h"
+#include "gzip_pipeline.h"
+
+namespace {
+
+const int READ_SIZE = 4 * 1024 * 1024;
+
+} // end of anonymous namespace
+
+DumpIndexer::DumpIndexer():
+    offset_(0) {
+}
+
+void DumpIndexer::addLines(const char* data, int size) {
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end) {
+        const char* nl = (const char*)memchr(line, '\n', end - line);
+        const char* line_end = nl ? nl + 1 : end;
+        names_.addRecord(offset_, line, line_end - line);
+        snapshot_.addRecord(offset_, line, line_end - line);
+        hashes_.addRecord(offset_, line, line_end - line);
+        ids_.addRecord(offset_, line, line_end - line);
+        offset_ += line_end - line;
+        line = line_end;
+    }
+}
+
+bool DumpIndexer::save(const QString& dump_path) {
+    QFileInfo dump(dump_path);
+    return names_.save(NameIndex::indexPath(dump_path), dump) &&
+           snapshot_.save(DumpSnapshot::snapshotPath(dump_path), dump) &&
+           hashes_.save(HashIndex::indexPath(dump_path), dump) &&
+           ids_.save(IdIndex::dumpIndexPath(dump_path), dump);
+}
+
+IndexingThread::IndexingThread(QString dump_path):
+    dump_path_(dump_path) {
+}
+
+void IndexingThread::run() {
+    bool ok = true;
+    if (dump_path_.endsWith(".gz")) {
+        GzipIndex gz_index;
+        ok = gz_index.build(dump_path_) && gz_index.save(dump_path_);
+    }
+    DumpIndexer indexer;
+    ok = ok && readDump(&indexer) && indexer.save(dump_path_);
+    emit finished(ok);
+}
+
+// offsets of compressed dumps are uncompressed ones
+bool IndexingThread::readDump(DumpIndexer* indexer) {
+    if (dump_path_.endsWith(".gz")) {
+        GzipPipeline pipeline(dump_path_);
+        if (!pipeline.start()) {
+            return false;
+        }
+        GzipPipeline::Block block;
+        while (pipeline.next(&block)) {
+            indexer->addLines(block.joined.constData(), block.joined.size());
+            indexer->addLines(block.data, block.size);
+            pipeline.release(block);
+        }
+        return !pipeline.failed();
+    }
+    QFile file(dump_path_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray buffer;
+    while (true) {
+        int old_size = buffer.size();
+        buffer.resize(old_size + READ_SIZE);
+        qint64 got = file.read(buffer.data() + old_size, READ_SIZE);
+        if (got < 0) {
+            return false;
+        }
+        buffer.resize(old_size + got);
+        if (got == 0) {
+            indexer->addLines(buffer.constData(), buffer.size());
+            return true;
+        }
+        // the last incomplete line waits for the next read
+        int complete = buffer.lastIndexOf('\n') + 1;
+        indexer->addLines(buffer.constData(), complete);
+        buffer.remove(0, complete);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef DUMP_INDEXER_H
+#define DUMP_INDEXER_H
+
+#include <QtCore>
+#include "name_index.h"
+#include "dump_snapshot.h"
+#include "hash_index.h"
+#include "id_index.h"
+
+// Builds the files derived from the lines of a dump in one pass: the
+// trigram index, the columnar snapshot, the hash index and the id table.
+class DumpIndexer {
+public:
+    DumpIndexer();
+
+    // lines must come in file order; data holds complete lines, except
+    // maybe the last line of the dump
+    void addLines(const char* data, int size);
+
+    // dump_path must already have its final size and mtime
+    bool save(const QString& dump_path);
+
+private:
+    NameIndexBuilder names_;
+    DumpSnapshotBuilder snapshot_;
+    HashIndexBuilder hashes_;
+    IdIndexBuilder ids_;
+    qint64 offset_;
+};
+
+// Builds the indexes of a dump: for compressed dumps the gzip index, then
+// the trigram index, the snapshot, the hash index and the id table.
+class IndexingThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    IndexingThread(QString dump_path);
+    void run();
+signals:
+    void finished(bool ok);
+private:
+    QString dump_path_;
+
+    bool readDump(DumpIndexer* indexer);
+};
+
+#endif // DUMP_INDEXER_H
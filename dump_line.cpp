@@ -0,0 +1,82 @@
+#include "dump_line.h"
+#include <algorithm>
+
+bool nameField(const char* line, int size, const char** name, int* name_size) {
+    // same rules as QString::split: exactly 8 tab separated fields,
+    // otherwise at least 8 '|' separated ones
+    int tabs = 0;
+    int pipes = 0;
+    int tab_pos[2] = {-1, -1};
+    int pipe_pos[2] = {-1, -1};
+    for (int i = 0; i < size; i++) {
+        char c = line[i];
+        if (c == '\t') {
+            if (tabs < 2) {
+                tab_pos[tabs] = i;
+            }
+            tabs += 1;
+        } else if (c == '|') {
+            if (pipes < 2) {
+                pipe_pos[pipes] = i;
+            }
+            pipes += 1;
+        }
+    }
+    const int* pos;
+    if (tabs == 7) {
+        pos = tab_pos;
+    } else if (pipes >= 7) {
+        pos = pipe_pos;
+    } else {
+        return false;
+    }
+    *name = line + pos[0] + 1;
+    *name_size = pos[1] - pos[0] - 1;
+    return true;
+}
+
+bool splitRecord(const char* line, int size, RecordFields* fields) {
+    while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r')) {
+        size--;
+    }
+    const char* end = line + size;
+    char separator = '\t';
+    if (std::count(line, end, '\t') != FIELD_COUNT - 1) {
+        if (std::count(line, end, '|') < FIELD_COUNT - 1) {
+            return false;
+        }
+        separator = '|';
+    }
+    const char* field = line;
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        const char* next = (const char*)memchr(field, separator, end - field);
+        if (!next) {
+            next = end;
+        }
+        fields->begin[i] = field;
+        fields->size[i] = next - field;
+        field = next < end ? next + 1 : end;
+    }
+    return true;
+}
+
+QDateTime parseUpdated(QString text) {
+    text.replace("Jan", "01");
+    text.replace("Feb", "02");
+    text.replace("Mar", "03");
+    text.replace("Apr", "04");
+    text.replace("May", "05");
+    text.replace("Jun", "06");
+    text.replace("Jul", "07");
+    text.replace("Aug", "08");
+    text.replace("Sep", "09");
+    text.replace("Oct", "10");
+    text.replace("Nov", "11");
+    text.replace("Dec", "12");
+    QDateTime datetime = QDateTime::fromString(text, "dd-MM-yy HH:mm");
+    if (datetime.date().year() < 2000) {
+        // shit like 1909 on place of 2009
+        datetime = datetime.addYears(100);
+    }
+    return datetime;
+}
@@ -0,0 +1,42 @@
+#ifndef DUMP_LINE_H
+#define DUMP_LINE_H
+
+#include <QtCore>
+
+// Helpers for raw lines of final.txt. A record has 8 fields separated by
+// '\t' (or by '|' in older dumps):
+// id, name, size, seeds, leeches, hash, downloads, updated.
+
+// Finds the name field of a line without decoding it.
+// Returns false if the line is not a record.
+bool nameField(const char* line, int size, const char** name, int* name_size);
+
+enum {
+    FIELD_ID,
+    FIELD_NAME,
+    FIELD_SIZE,
+    FIELD_SEEDS,
+    FIELD_LEECHES,
+    FIELD_HASH,
+    FIELD_DOWNLOADS,
+    FIELD_UPDATED,
+    FIELD_COUNT
+};
+
+struct RecordFields {
+    const char* begin[FIELD_COUNT];
+    int size[FIELD_COUNT];
+
+    QByteArray field(int i) const {
+        return QByteArray::fromRawData(begin[i], size[i]);
+    }
+};
+
+// Splits a record into its fields without decoding them, the line end
+// is not part of the last field. Returns false if the line is not a record.
+bool splitRecord(const char* line, int size, RecordFields* fields);
+
+// Parses the updated field ("25-Dec-12 13:45").
+QDateTime parseUpdated(QString text);
+
+#endif // DUMP_LINE_H
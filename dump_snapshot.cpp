@@ -0,0 +1,204 @@
+#include "dump_snapshot.h"
+#include <algorithm>
+#include <climits>
+#include "dump_line.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'D', 'V', 'C', 'O', 'L', 'S', '0', '1'};
+
+struct SnapshotHeader {
+    char magic[8];
+    qint64 dump_size;
+    qint64 dump_mtime;
+    quint64 row_count;
+    quint64 heap_size;
+    // 8 byte columns first, then 4 byte ones, then bytes
+    quint64 offsets_pos;
+    quint64 sizes_pos;
+    quint64 downloads_pos;
+    quint64 names_pos;
+    quint64 ids_pos;
+    quint64 seeds_pos;
+    quint64 leeches_pos;
+    quint64 updated_pos;
+    quint64 hashes_pos;
+    quint64 heap_pos;
+};
+
+// fills the positions of the columns, returns the file size
+quint64 layout(SnapshotHeader* h) {
+    quint64 n = h->row_count;
+    h->offsets_pos = sizeof(SnapshotHeader);
+    h->sizes_pos = h->offsets_pos + n * sizeof(qint64);
+    h->downloads_pos = h->sizes_pos + n * sizeof(qint64);
+    h->names_pos = h->downloads_pos + n * sizeof(qint64);
+    h->ids_pos = h->names_pos + (n + 1) * sizeof(quint64);
+    h->seeds_pos = h->ids_pos + n * sizeof(qint32);
+    h->leeches_pos = h->seeds_pos + n * sizeof(qint32);
+    h->updated_pos = h->leeches_pos + n * sizeof(qint32);
+    h->hashes_pos = h->updated_pos + n * sizeof(quint32);
+    h->heap_pos = h->hashes_pos + n * DumpSnapshot::HASH_SIZE;
+    return h->heap_pos + h->heap_size;
+}
+
+template<typename T>
+bool writeColumn(QFile* out, const QVector<T>& column) {
+    qint64 bytes = column.size() * sizeof(T);
+    return out->write((const char*)column.constData(), bytes) == bytes;
+}
+
+} // end of anonymous namespace
+
+DumpSnapshotBuilder::DumpSnapshotBuilder() {
+    names_ << 0;
+}
+
+void DumpSnapshotBuilder::addRecord(qint64 offset, const char* line, int size) {
+    RecordFields fields;
+    if (!splitRecord(line, size, &fields)) {
+        return;
+    }
+    offsets_ << offset;
+    ids_ << fields.field(FIELD_ID).toInt();
+    heap_.append(fields.begin[FIELD_NAME], fields.size[FIELD_NAME]);
+    heap_.append('\n');
+    names_ << heap_.size();
+    sizes_ << fields.field(FIELD_SIZE).toLongLong();
+    seeds_ << fields.field(FIELD_SEEDS).toInt();
+    leeches_ << fields.field(FIELD_LEECHES).toInt();
+    QByteArray hash = torrent_hash_bytes(QString::fromLatin1(fields.begin[FIELD_HASH],
+                                                             fields.size[FIELD_HASH]));
+    hash = hash.left(DumpSnapshot::HASH_SIZE);
+    hash.append(QByteArray(DumpSnapshot::HASH_SIZE - hash.size(), '\0'));
+    hashes_.append(hash);
+    downloads_ << fields.field(FIELD_DOWNLOADS).toLongLong();
+    QDateTime updated = parseUpdated(QString::fromLatin1(fields.begin[FIELD_UPDATED],
+                                                         fields.size[FIELD_UPDATED]));
+    updated_ << (updated.isValid() ? updated.toTime_t() : 0);
+}
+
+bool DumpSnapshotBuilder::save(const QString& snapshot_path, const QFileInfo& dump) const {
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.dump_size = dump.size();
+    header.dump_mtime = dump.lastModified().toTime_t();
+    header.row_count = ids_.size();
+    header.heap_size = heap_.size();
+    layout(&header);
+
+    QString tmp_path = snapshot_path + ".tmp";
+    QFile out(tmp_path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write snapshot" << tmp_path;
+        return false;
+    }
+    bool ok = out.write((const char*)&header, sizeof(header)) == sizeof(header);
+    ok = ok && writeColumn(&out, offsets_);
+    ok = ok && writeColumn(&out, sizes_);
+    ok = ok && writeColumn(&out, downloads_);
+    ok = ok && writeColumn(&out, names_);
+    ok = ok && writeColumn(&out, ids_);
+    ok = ok && writeColumn(&out, seeds_);
+    ok = ok && writeColumn(&out, leeches_);
+    ok = ok && writeColumn(&out, updated_);
+    ok = ok && out.write(hashes_) == hashes_.size();
+    ok = ok && out.write(heap_) == heap_.size();
+    out.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(snapshot_path);
+    return QFile::rename(tmp_path, snapshot_path);
+}
+
+DumpSnapshot::DumpSnapshot():
+    map_(0), row_count_(0), offsets_(0), ids_(0), sizes_(0), seeds_(0),
+    leeches_(0), downloads_(0), updated_(0), hashes_(0), names_(0), heap_(0) {
+}
+
+DumpSnapshot::~DumpSnapshot() {
+    close();
+}
+
+QString DumpSnapshot::snapshotPath(const QString& dump_path) {
+    return dump_path + ".columns";
+}
+
+bool DumpSnapshot::open(const QString& dump_path) {
+    close();
+    QFileInfo dump(dump_path);
+    file_.setFileName(snapshotPath(dump_path));
+    if (!dump.exists() || !file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file_.size();
+    if (size < qint64(sizeof(SnapshotHeader))) {
+        file_.close();
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (!map_) {
+        file_.close();
+        return false;
+    }
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(map_);
+    SnapshotHeader expected = *header;
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->dump_size == dump.size() &&
+                 header->dump_mtime == qint64(dump.lastModified().toTime_t()) &&
+                 header->row_count < quint64(INT_MAX) &&
+                 layout(&expected) == quint64(size) &&
+                 memcmp(&expected, header, sizeof(expected)) == 0;
+    if (!valid) {
+        qDebug() << "stale or broken snapshot" << file_.fileName();
+        close();
+        return false;
+    }
+    row_count_ = header->row_count;
+    offsets_ = reinterpret_cast<const qint64*>(map_ + header->offsets_pos);
+    sizes_ = reinterpret_cast<const qint64*>(map_ + header->sizes_pos);
+    downloads_ = reinterpret_cast<const qint64*>(map_ + header->downloads_pos);
+    names_ = reinterpret_cast<const quint64*>(map_ + header->names_pos);
+    ids_ = reinterpret_cast<const qint32*>(map_ + header->ids_pos);
+    seeds_ = reinterpret_cast<const qint32*>(map_ + header->seeds_pos);
+    leeches_ = reinterpret_cast<const qint32*>(map_ + header->leeches_pos);
+    updated_ = reinterpret_cast<const quint32*>(map_ + header->updated_pos);
+    hashes_ = reinterpret_cast<const char*>(map_ + header->hashes_pos);
+    heap_ = reinterpret_cast<const char*>(map_ + header->heap_pos);
+    return true;
+}
+
+void DumpSnapshot::close() {
+    if (map_) {
+        file_.unmap(map_);
+        map_ = 0;
+    }
+    if (file_.isOpen()) {
+        file_.close();
+    }
+    row_count_ = 0;
+    offsets_ = 0;
+    ids_ = seeds_ = leeches_ = 0;
+    sizes_ = downloads_ = 0;
+    updated_ = 0;
+    hashes_ = heap_ = 0;
+    names_ = 0;
+}
+
+int DumpSnapshot::rowAt(qint64 heap_offset) const {
+    // the first name starting after heap_offset, minus one
+    const quint64* row = std::upper_bound(names_, names_ + row_count_ + 1,
+                                          quint64(heap_offset));
+    return row - names_ - 1;
+}
+
+int DumpSnapshot::rowAtOffset(qint64 offset) const {
+    const qint64* row = std::lower_bound(offsets_, offsets_ + row_count_, offset);
+    if (row == offsets_ + row_count_ || *row != offset) {
+        return -1;
+    }
+    return row - offsets_;
+}
@@ -0,0 +1,133 @@
+#ifndef DUMP_SNAPSHOT_H
+#define DUMP_SNAPSHOT_H
+
+#include <QtCore>
+
+// Columnar copy of final.txt, parsed once.
+//
+// The snapshot lives next to the dump (final.txt.columns) and is mapped
+// into memory as a whole. Every field is a dense fixed width column:
+// line offsets, ids, sizes, seeds, leeches, downloads, update times and
+// 20 byte hashes. Names are raw bytes of the dump in one heap, each
+// followed by '\n', so a substring search over the heap never matches
+// across two names.
+
+class DumpSnapshotBuilder {
+public:
+    DumpSnapshotBuilder();
+
+    // raw dump line at offset, skipped if it is not a record
+    void addRecord(qint64 offset, const char* line, int size);
+
+    bool save(const QString& snapshot_path, const QFileInfo& dump) const;
+
+private:
+    QVector<qint64> offsets_;
+    QVector<qint32> ids_;
+    QVector<qint64> sizes_;
+    QVector<qint32> seeds_;
+    QVector<qint32> leeches_;
+    QVector<qint64> downloads_;
+    QVector<quint32> updated_;
+    QByteArray hashes_;
+    QVector<quint64> names_; // heap offsets, one more than rows
+    QByteArray heap_;
+};
+
+class DumpSnapshot {
+public:
+    enum {
+        HASH_SIZE = 20
+    };
+
+    DumpSnapshot();
+    ~DumpSnapshot();
+
+    // maps the snapshot of dump_path; fails if it is missing or stale
+    bool open(const QString& dump_path);
+    void close();
+    bool isOpen() const {
+        return map_ != 0;
+    }
+
+    static QString snapshotPath(const QString& dump_path);
+
+    int rowCount() const {
+        return row_count_;
+    }
+
+    // offset of the line in the uncompressed dump
+    qint64 lineOffset(int row) const {
+        return offsets_[row];
+    }
+
+    int id(int row) const {
+        return ids_[row];
+    }
+
+    qint64 torrentSize(int row) const {
+        return sizes_[row];
+    }
+
+    int seeds(int row) const {
+        return seeds_[row];
+    }
+
+    int leeches(int row) const {
+        return leeches_[row];
+    }
+
+    qint64 downloads(int row) const {
+        return downloads_[row];
+    }
+
+    // time_t, 0 if unknown
+    uint updated(int row) const {
+        return updated_[row];
+    }
+
+    const char* hashData(int row) const {
+        return hashes_ + row * HASH_SIZE;
+    }
+
+    const char* nameData(int row) const {
+        return heap_ + names_[row];
+    }
+
+    int nameSize(int row) const {
+        return names_[row + 1] - names_[row] - 1;
+    }
+
+    const char* heap() const {
+        return heap_;
+    }
+
+    qint64 heapSize() const {
+        return names_[row_count_];
+    }
+
+    // row whose name holds the heap offset
+    int rowAt(qint64 heap_offset) const;
+
+    // row of the line at the offset of the dump, -1 if there is none
+    int rowAtOffset(qint64 offset) const;
+
+private:
+    Q_DISABLE_COPY(DumpSnapshot)
+
+    QFile file_;
+    uchar* map_;
+    int row_count_;
+    const qint64* offsets_;
+    const qint32* ids_;
+    const qint64* sizes_;
+    const qint32* seeds_;
+    const qint32* leeches_;
+    const qint64* downloads_;
+    const quint32* updated_;
+    const char* hashes_;
+    const quint64* names_;
+    const char* heap_;
+};
+
+#endif // DUMP_SNAPSHOT_H
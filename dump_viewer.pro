@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui webkit
+QT       += core gui webkit network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,12 +16,54 @@ TEMPLATE = app
 SOURCES += main.cpp\
         mainwindow.cpp \
     torrent_hash_convert.cpp \
+    name_index.cpp \
+    dump_line.cpp \
+    dump_snapshot.cpp \
+    dump_indexer.cpp \
+    name_matcher.cpp \
+    searching_thread.cpp \
+    gzip_index.cpp \
+    gzip_pipeline.cpp \
+    unpacking_thread.cpp \
+    description_archive.cpp \
+    description_cache.cpp \
+    description_loader.cpp \
+    description_store.cpp \
+    hash_index.cpp \
+    id_index.cpp \
+    console_search.cpp \
+    query_server.cpp \
+    search_query.cpp \
+    result_store.cpp \
+    result_ring.cpp \
+    results_model.cpp \
     arpmanetdc/base32.cpp \
     arpmanetdc/util.cpp \
     quazip/quagzipfile.cpp
 
 HEADERS  += mainwindow.h \
     torrent_hash_convert.h \
+    name_index.h \
+    dump_line.h \
+    dump_snapshot.h \
+    dump_indexer.h \
+    name_matcher.h \
+    searching_thread.h \
+    gzip_index.h \
+    gzip_pipeline.h \
+    unpacking_thread.h \
+    description_archive.h \
+    description_cache.h \
+    description_loader.h \
+    description_store.h \
+    hash_index.h \
+    id_index.h \
+    console_search.h \
+    query_server.h \
+    search_query.h \
+    result_store.h \
+    result_ring.h \
+    results_model.h \
     arpmanetdc/base32.h \
     arpmanetdc/util.h \
     quazip/quazip_global.h \
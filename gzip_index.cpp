@@ -0,0 +1,383 @@
+#include "gzip_index.h"
+
+namespace {
+
+const quint32 GZIP_INDEX_MAGIC = 0x445a4958; // "DZIX"
+const quint32 GZIP_INDEX_VERSION = 1;
+const int INPUT_SIZE = 256 * 1024;
+const int OUTPUT_BLOCK = 256 * 1024;
+
+} // end of anonymous namespace
+
+GzipIndex::GzipIndex():
+    uncompressed_size_(0) {
+}
+
+QString GzipIndex::indexPath(const QString& gz_path) {
+    return gz_path + ".zidx";
+}
+
+void GzipIndex::addPoint(qint64 out, qint64 in, int bits, char before,
+                         const QByteArray& window) {
+    Point point;
+    point.out = out;
+    point.in = in;
+    point.bits = bits;
+    point.before = before;
+    if (!window.isEmpty()) {
+        point.window = qCompress(window);
+    }
+    points_.append(point);
+}
+
+bool GzipIndex::build(const QString& gz_path, qint64 span) {
+    points_.clear();
+    uncompressed_size_ = 0;
+    QFile file(gz_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray input(INPUT_SIZE, 0);
+    QByteArray window(WINDOW_SIZE, 0);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 47) != Z_OK) { // gzip or zlib header
+        return false;
+    }
+    qint64 totin = 0;
+    qint64 totout = 0;
+    qint64 last = 0;
+    addPoint(0, 0, -1, '\n', QByteArray());
+    bool ok = true;
+    while (true) {
+        if (strm.avail_in == 0) {
+            qint64 n = file.read(input.data(), INPUT_SIZE);
+            if (n <= 0) {
+                qDebug() << "truncated gzip file" << gz_path;
+                ok = false;
+                break;
+            }
+            strm.next_in = (Bytef*)input.data();
+            strm.avail_in = n;
+        }
+        if (strm.avail_out == 0) {
+            strm.next_out = (Bytef*)window.data();
+            strm.avail_out = WINDOW_SIZE;
+        }
+        totin += strm.avail_in;
+        totout += strm.avail_out;
+        int ret = inflate(&strm, Z_BLOCK); // stop at the end of each block
+        totin -= strm.avail_in;
+        totout -= strm.avail_out;
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+            ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+            qDebug() << "inflate error" << ret << gz_path;
+            ok = false;
+            break;
+        }
+        // the window is circular, window_pos is where the next byte goes
+        int window_pos = WINDOW_SIZE - strm.avail_out;
+        char before = totout == 0 ? '\n' :
+                      window[(window_pos + WINDOW_SIZE - 1) % WINDOW_SIZE];
+        if (ret == Z_STREAM_END) {
+            if (strm.avail_in == 0) {
+                qint64 n = file.read(input.data(), INPUT_SIZE);
+                if (n > 0) {
+                    strm.next_in = (Bytef*)input.data();
+                    strm.avail_in = n;
+                }
+            }
+            if (strm.avail_in == 0 || *strm.next_in != 0x1f) {
+                break; // the last member, maybe followed by padding
+            }
+            inflateReset(&strm);
+            addPoint(totout, totin, -1, before, QByteArray());
+            last = totout;
+            continue;
+        }
+        if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+            totout - last > span) {
+            QByteArray ordered = window.mid(window_pos) + window.left(window_pos);
+            addPoint(totout, totin, strm.data_type & 7, before, ordered);
+            last = totout;
+        }
+    }
+    inflateEnd(&strm);
+    if (!ok) {
+        points_.clear();
+        return false;
+    }
+    uncompressed_size_ = totout;
+    return true;
+}
+
+bool GzipIndex::save(const QString& gz_path) const {
+    QFileInfo info(gz_path);
+    QString index_path = indexPath(gz_path);
+    QString tmp_path = index_path + ".tmp";
+    QFile file(tmp_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write gzip index" << tmp_path;
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << GZIP_INDEX_MAGIC << GZIP_INDEX_VERSION
+        << qint64(info.size()) << qint64(info.lastModified().toTime_t())
+        << uncompressed_size_ << qint32(points_.size());
+    foreach (const Point& point, points_) {
+        out << point.out << point.in << qint32(point.bits)
+            << qint8(point.before) << point.window;
+    }
+    bool ok = out.status() == QDataStream::Ok;
+    file.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(index_path);
+    return QFile::rename(tmp_path, index_path);
+}
+
+bool GzipIndex::load(const QString& gz_path) {
+    points_.clear();
+    uncompressed_size_ = 0;
+    QFileInfo info(gz_path);
+    QFile file(indexPath(gz_path));
+    if (!info.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+    quint32 magic, version;
+    qint64 gz_size, gz_mtime;
+    qint32 count;
+    in >> magic >> version >> gz_size >> gz_mtime >> uncompressed_size_ >> count;
+    if (in.status() != QDataStream::Ok || magic != GZIP_INDEX_MAGIC ||
+        version != GZIP_INDEX_VERSION || gz_size != info.size() ||
+        gz_mtime != qint64(info.lastModified().toTime_t()) || count <= 0) {
+        qDebug() << "stale or broken gzip index" << file.fileName();
+        uncompressed_size_ = 0;
+        return false;
+    }
+    points_.resize(count);
+    for (int i = 0; i < count; i++) {
+        Point& point = points_[i];
+        qint32 bits;
+        qint8 before;
+        in >> point.out >> point.in >> bits >> before >> point.window;
+        point.bits = bits;
+        point.before = before;
+    }
+    if (in.status() != QDataStream::Ok) {
+        points_.clear();
+        uncompressed_size_ = 0;
+        return false;
+    }
+    return true;
+}
+
+int GzipIndex::pointBefore(qint64 offset) const {
+    int lo = 0;
+    int hi = points_.size();
+    // the first point after offset
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (points_[mid].out <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return qMax(0, lo - 1);
+}
+
+GzipIndexReader::GzipIndexReader(const QString& gz_path, const GzipIndex* index):
+    file_(gz_path), index_(index), stream_open_(false), raw_(false),
+    finished_(true), error_(false), buffer_pos_(0), pos_(0) {
+    memset(&strm_, 0, sizeof(strm_));
+    file_.open(QIODevice::ReadOnly);
+}
+
+GzipIndexReader::~GzipIndexReader() {
+    if (stream_open_) {
+        inflateEnd(&strm_);
+    }
+}
+
+bool GzipIndexReader::startAt(int i) {
+    if (stream_open_) {
+        inflateEnd(&strm_);
+        stream_open_ = false;
+    }
+    finished_ = true;
+    buffer_.clear();
+    buffer_pos_ = 0;
+    if (!file_.isOpen() || i < 0 || i >= index_->size()) {
+        return false;
+    }
+    const GzipIndex::Point& point = index_->points_[i];
+    memset(&strm_, 0, sizeof(strm_));
+    if (!file_.seek(point.bits > 0 ? point.in - 1 : point.in)) {
+        return false;
+    }
+    raw_ = point.bits >= 0;
+    if (inflateInit2(&strm_, raw_ ? -15 : 47) != Z_OK) {
+        return false;
+    }
+    stream_open_ = true;
+    if (point.bits > 0) {
+        char c;
+        if (!file_.getChar(&c)) {
+            return false;
+        }
+        inflatePrime(&strm_, point.bits, uchar(c) >> (8 - point.bits));
+    }
+    if (raw_) {
+        QByteArray window = qUncompress(point.window);
+        inflateSetDictionary(&strm_, (const Bytef*)window.constData(), window.size());
+    }
+    finished_ = false;
+    pos_ = point.out;
+    return true;
+}
+
+bool GzipIndexReader::refillInput() {
+    if (input_.size() != INPUT_SIZE) {
+        input_.resize(INPUT_SIZE);
+    }
+    qint64 n = file_.read(input_.data(), INPUT_SIZE);
+    if (n <= 0) {
+        return false;
+    }
+    strm_.next_in = (Bytef*)input_.data();
+    strm_.avail_in = n;
+    return true;
+}
+
+bool GzipIndexReader::skipInput(int count) {
+    while (count > 0) {
+        if (strm_.avail_in == 0 && !refillInput()) {
+            return false;
+        }
+        int n = qMin(count, int(strm_.avail_in));
+        strm_.next_in += n;
+        strm_.avail_in -= n;
+        count -= n;
+    }
+    return true;
+}
+
+void GzipIndexReader::fail(const char* what) {
+    qDebug() << what << file_.fileName();
+    error_ = true;
+    finished_ = true;
+}
+
+// The end of the file is clean only right after the end of a member.
+bool GzipIndexReader::fill() {
+    if (!stream_open_ || finished_) {
+        return false;
+    }
+    if (buffer_pos_ > 0) {
+        buffer_.remove(0, buffer_pos_);
+        buffer_pos_ = 0;
+    }
+    int old_size = buffer_.size();
+    buffer_.resize(old_size + OUTPUT_BLOCK);
+    strm_.next_out = (Bytef*)buffer_.data() + old_size;
+    strm_.avail_out = OUTPUT_BLOCK;
+    while (strm_.avail_out > 0) {
+        if (strm_.avail_in == 0 && !refillInput()) {
+            fail("truncated gzip file");
+            break;
+        }
+        int ret = inflate(&strm_, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+            ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+            fail("inflate error");
+            break;
+        }
+        if (ret == Z_STREAM_END) {
+            // raw inflate leaves the member trailer in the input
+            if (raw_ && !skipInput(8)) {
+                fail("truncated gzip file");
+                break;
+            }
+            if ((strm_.avail_in == 0 && !refillInput()) || *strm_.next_in != 0x1f) {
+                finished_ = true;
+                break;
+            }
+            if (raw_) {
+                inflateEnd(&strm_);
+                stream_open_ = false;
+                if (inflateInit2(&strm_, 47) != Z_OK) {
+                    fail("can not inflate");
+                    break;
+                }
+                stream_open_ = true;
+                raw_ = false;
+            } else {
+                inflateReset(&strm_);
+            }
+        }
+    }
+    int got = OUTPUT_BLOCK - strm_.avail_out;
+    buffer_.resize(old_size + got);
+    return got > 0;
+}
+
+bool GzipIndexReader::seek(qint64 offset) {
+    if (error_) {
+        return false;
+    }
+    int point = index_->pointBefore(offset);
+    if (!stream_open_ || offset < pos_ || index_->points_[point].out > pos_) {
+        if (!startAt(point)) {
+            return false;
+        }
+    }
+    while (pos_ < offset) {
+        if (buffer_pos_ == buffer_.size() && !fill()) {
+            return false;
+        }
+        int n = int(qMin(qint64(buffer_.size() - buffer_pos_), offset - pos_));
+        buffer_pos_ += n;
+        pos_ += n;
+    }
+    return true;
+}
+
+int GzipIndexReader::read(char* data, int max_size) {
+    int total = 0;
+    while (total < max_size) {
+        if (buffer_pos_ == buffer_.size() && !fill()) {
+            break;
+        }
+        int n = qMin(max_size - total, buffer_.size() - buffer_pos_);
+        memcpy(data + total, buffer_.constData() + buffer_pos_, n);
+        buffer_pos_ += n;
+        pos_ += n;
+        total += n;
+    }
+    if (total == 0 && (error_ || !stream_open_)) {
+        return -1;
+    }
+    return total;
+}
+
+QByteArray GzipIndexReader::readLine() {
+    QByteArray line;
+    while (true) {
+        const char* begin = buffer_.constData() + buffer_pos_;
+        int available = buffer_.size() - buffer_pos_;
+        const char* nl = (const char*)memchr(begin, '\n', available);
+        int n = nl ? nl + 1 - begin : available;
+        line.append(begin, n);
+        buffer_pos_ += n;
+        pos_ += n;
+        if (nl || !fill()) {
+            return line;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef GZIP_INDEX_H
+#define GZIP_INDEX_H
+
+#include <QtCore>
+#include <zlib.h>
+
+// Random access to gzip files, after zran.c from the zlib examples.
+//
+// While the whole file is inflated once, the inflate state is saved every
+// span bytes of output at a deflate block boundary: the position in the
+// compressed file, the pending bits and the last 32K of output (the
+// window). Inflating can then start at any saved point. Multi-member
+// files get a point at the start of every member.
+// The index is stored next to the dump (final.txt.gz.zidx).
+
+class GzipIndex {
+public:
+    enum {
+        DEFAULT_SPAN = 4 * 1024 * 1024,
+        WINDOW_SIZE = 32768
+    };
+
+    GzipIndex();
+
+    static QString indexPath(const QString& gz_path);
+
+    // inflates the whole file once
+    bool build(const QString& gz_path, qint64 span = DEFAULT_SPAN);
+    bool save(const QString& gz_path) const;
+    // fails if the index is missing or stale
+    bool load(const QString& gz_path);
+
+    int size() const {
+        return points_.size();
+    }
+
+    qint64 uncompressedSize() const {
+        return uncompressed_size_;
+    }
+
+    // uncompressed offset of point i
+    qint64 pointOffset(int i) const {
+        return points_[i].out;
+    }
+
+    // uncompressed byte just before point i ('\n' for the first one)
+    char byteBefore(int i) const {
+        return points_[i].before;
+    }
+
+    // the last point at or before the uncompressed offset
+    int pointBefore(qint64 offset) const;
+
+private:
+    struct Point {
+        qint64 out;        // uncompressed offset
+        qint64 in;         // compressed offset of the first full byte
+        int bits;          // bits of the byte before in, -1 at member start
+        char before;
+        QByteArray window; // qCompress'ed, empty at member start
+    };
+
+    QVector<Point> points_;
+    qint64 uncompressed_size_;
+
+    void addPoint(qint64 out, qint64 in, int bits, char before,
+                  const QByteArray& window);
+
+    friend class GzipIndexReader;
+};
+
+// Sequential reader of a gzip file which starts at index points.
+// Each thread needs its own reader.
+class GzipIndexReader {
+public:
+    GzipIndexReader(const QString& gz_path, const GzipIndex* index);
+    ~GzipIndexReader();
+
+    // moves to the uncompressed offset, inflating only from the nearest
+    // point before it (or continuing forward if that is closer)
+    bool seek(qint64 offset);
+
+    qint64 pos() const {
+        return pos_;
+    }
+
+    QString fileName() const {
+        return file_.fileName();
+    }
+
+    // returns the number of bytes read, 0 at the end and -1 on errors
+    int read(char* data, int max_size);
+
+    // line with its '\n', empty at the end
+    QByteArray readLine();
+
+    // true once inflating hit corrupt or truncated data; reads and seeks
+    // fail from then on instead of looking like the end of the file
+    bool failed() const {
+        return error_;
+    }
+
+private:
+    Q_DISABLE_COPY(GzipIndexReader)
+
+    QFile file_;
+    const GzipIndex* index_;
+    z_stream strm_;
+    bool stream_open_;
+    bool raw_;         // raw deflate from a point inside a member
+    bool finished_;
+    bool error_;
+    QByteArray input_;
+    QByteArray buffer_; // inflated bytes not yet returned
+    int buffer_pos_;
+    qint64 pos_;
+
+    bool startAt(int point);
+    bool skipInput(int count);
+    bool refillInput();
+    // inflates more bytes into buffer_; false at the end or on errors
+    bool fill();
+    void fail(const char* what);
+};
+
+#endif // GZIP_INDEX_H
@@ -0,0 +1,374 @@
+#include "gzip_pipeline.h"
+#include <zlib.h>
+
+namespace {
+
+const int INPUT_SIZE = 1024 * 1024;
+const int GZIP_HEADER_SIZE = 12; // up to and including XLEN
+const int BGZF_MAX_BLOCK = 65536; // uncompressed bytes per BGZF member
+
+// compressed size of the BGZF member starting at header, -1 if it is not
+// a BGZF member or the header is incomplete
+int bgzfMemberSize(const QByteArray& header) {
+    const uchar* h = (const uchar*)header.constData();
+    if (header.size() < GZIP_HEADER_SIZE || h[0] != 0x1f || h[1] != 0x8b ||
+        h[2] != Z_DEFLATED || !(h[3] & 4)) { // FEXTRA
+        return -1;
+    }
+    int xlen = h[10] | (h[11] << 8);
+    if (header.size() < GZIP_HEADER_SIZE + xlen) {
+        return -1;
+    }
+    const uchar* p = h + GZIP_HEADER_SIZE;
+    const uchar* end = p + xlen;
+    while (p + 4 <= end) {
+        int slen = p[2] | (p[3] << 8);
+        if (p[0] == 'B' && p[1] == 'C' && slen == 2 && p + 6 <= end) {
+            return (p[4] | (p[5] << 8)) + 1;
+        }
+        p += 4 + slen;
+    }
+    return -1;
+}
+
+bool refillInput(QFile* file, QByteArray* input, z_stream* strm) {
+    qint64 n = file->read(input->data(), input->size());
+    if (n <= 0) {
+        return false;
+    }
+    strm->next_in = (Bytef*)input->data();
+    strm->avail_in = n;
+    return true;
+}
+
+} // end of anonymous namespace
+
+class InflateTask : public QRunnable {
+public:
+    InflateTask(GzipPipeline* pipeline):
+        pipeline_(pipeline) {
+    }
+
+    void run() {
+        if (pipeline_->bgzf_) {
+            pipeline_->inflateBlocks();
+        } else {
+            pipeline_->inflateStream();
+        }
+    }
+
+private:
+    GzipPipeline* pipeline_;
+};
+
+GzipPipeline::GzipPipeline(const QString& gz_path):
+    path_(gz_path), bgzf_(false), next_seq_(0), total_(-1), in_pos_(0), taken_(0),
+    cancelled_(false), error_(false), file_(gz_path), next_batch_(0),
+    read_end_(false) {
+}
+
+GzipPipeline::~GzipPipeline() {
+    cancel();
+    pool_.waitForDone();
+}
+
+bool GzipPipeline::start() {
+    if (!file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray header = file_.peek(GZIP_HEADER_SIZE);
+    if (header.size() < 2 || uchar(header[0]) != 0x1f || uchar(header[1]) != 0x8b) {
+        return false;
+    }
+    if (header.size() == GZIP_HEADER_SIZE && (header[3] & 4)) {
+        int xlen = uchar(header[10]) | (uchar(header[11]) << 8);
+        bgzf_ = bgzfMemberSize(file_.peek(GZIP_HEADER_SIZE + xlen)) > 0;
+    }
+    int threads = qMax(1, QThread::idealThreadCount());
+    int inflaters = bgzf_ ? threads : 1;
+    // consumers and inflaters both need room to run ahead
+    slots_.resize(threads * 2);
+    for (int i = 0; i < slots_.size(); i++) {
+        slots_[i].size = 0;
+        slots_[i].in_pos = 0;
+        slots_[i].seq = i;
+        slots_[i].state = EMPTY;
+    }
+    qDebug() << "gzip pipeline:" << (bgzf_ ? "BGZF," : "plain gzip,")
+             << inflaters << "inflaters";
+    pool_.setMaxThreadCount(inflaters);
+    for (int i = 0; i < inflaters; i++) {
+        pool_.start(new InflateTask(this));
+    }
+    return true;
+}
+
+// One inflater for the whole file, members follow each other.
+void GzipPipeline::inflateStream() {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 47) != Z_OK) { // gzip or zlib header
+        fail();
+        return;
+    }
+    QByteArray input(INPUT_SIZE, 0);
+    QByteArray buffer;
+    qint64 seq = 0;
+    bool end = false;
+    bool ok = true;
+    while (!end) {
+        if (buffer.size() < CHUNK_SIZE) {
+            buffer.resize(CHUNK_SIZE);
+        }
+        strm.next_out = (Bytef*)buffer.data();
+        strm.avail_out = CHUNK_SIZE;
+        while (strm.avail_out > 0) {
+            if (strm.avail_in == 0 && !refillInput(&file_, &input, &strm)) {
+                // a clean end comes with Z_STREAM_END, not here
+                qDebug() << "truncated gzip file" << path_;
+                ok = false;
+                end = true;
+                break;
+            }
+            int ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                if ((strm.avail_in == 0 && !refillInput(&file_, &input, &strm)) ||
+                    *strm.next_in != 0x1f) {
+                    end = true; // the last member, maybe followed by padding
+                    break;
+                }
+                inflateReset(&strm);
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                qDebug() << "inflate error" << ret << path_;
+                ok = false;
+                end = true;
+                break;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        if (!publish(seq, &buffer, CHUNK_SIZE - strm.avail_out,
+                     file_.pos() - strm.avail_in)) {
+            inflateEnd(&strm);
+            return;
+        }
+        seq += 1;
+    }
+    inflateEnd(&strm);
+    if (ok) {
+        finish(seq);
+    } else {
+        fail();
+    }
+}
+
+// Takes batches of whole BGZF members, every inflater on its own.
+void GzipPipeline::inflateBlocks() {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 31) != Z_OK) { // gzip header
+        fail();
+        return;
+    }
+    QByteArray compressed;
+    QByteArray buffer;
+    int compressed_size;
+    qint64 in_pos;
+    qint64 seq;
+    while (readBatch(&compressed, &compressed_size, &in_pos, &seq)) {
+        if (buffer.size() < CHUNK_SIZE) {
+            buffer.resize(CHUNK_SIZE);
+        }
+        strm.next_in = (Bytef*)compressed.data();
+        strm.avail_in = compressed_size;
+        strm.next_out = (Bytef*)buffer.data();
+        strm.avail_out = buffer.size();
+        bool ok = true;
+        while (strm.avail_in > 0) {
+            inflateReset(&strm);
+            if (inflate(&strm, Z_FINISH) != Z_STREAM_END) {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) {
+            qDebug() << "broken BGZF member in" << path_;
+            fail();
+            break;
+        }
+        if (!publish(seq, &buffer, buffer.size() - strm.avail_out, in_pos)) {
+            break;
+        }
+    }
+    inflateEnd(&strm);
+}
+
+// Reads whole members up to CHUNK_SIZE of uncompressed bytes.
+// The buffer is reused between batches, only size bytes of it are set.
+bool GzipPipeline::readBatch(QByteArray* compressed, int* size,
+                             qint64* in_pos, qint64* seq) {
+    QMutexLocker locker(&read_mutex_);
+    if (read_end_) {
+        return false;
+    }
+    int used = 0;
+    qint64 out_size = 0;
+    while (out_size + BGZF_MAX_BLOCK <= CHUNK_SIZE) {
+        QByteArray header = file_.peek(GZIP_HEADER_SIZE);
+        if (header.isEmpty()) {
+            break;
+        }
+        int xlen = header.size() == GZIP_HEADER_SIZE ?
+                   uchar(header[10]) | (uchar(header[11]) << 8) : 0;
+        int member_size = bgzfMemberSize(file_.peek(GZIP_HEADER_SIZE + xlen));
+        if (member_size < 0) {
+            qDebug() << "not a BGZF member at" << file_.pos() << path_;
+            read_end_ = true;
+            fail();
+            return false;
+        }
+        if (compressed->size() < used + member_size) {
+            compressed->resize(qMax(used + member_size, int(CHUNK_SIZE)));
+        }
+        if (file_.read(compressed->data() + used, member_size) != member_size) {
+            qDebug() << "truncated BGZF member in" << path_;
+            read_end_ = true;
+            fail();
+            return false;
+        }
+        used += member_size;
+        const uchar* isize = (const uchar*)compressed->constData() + used - 4;
+        out_size += isize[0] | (isize[1] << 8) | (isize[2] << 16) | (isize[3] << 24);
+    }
+    if (used == 0) {
+        read_end_ = true;
+        finish(next_batch_);
+        return false;
+    }
+    *size = used;
+    *in_pos = file_.pos();
+    *seq = next_batch_;
+    next_batch_ += 1;
+    return true;
+}
+
+bool GzipPipeline::publish(qint64 seq, QByteArray* buffer, int size, qint64 in_pos) {
+    QMutexLocker locker(&mutex_);
+    Slot& slot = slots_[seq % slots_.size()];
+    while (!cancelled_ && !error_ && (slot.seq != seq || slot.state != EMPTY)) {
+        slot_free_.wait(&mutex_);
+    }
+    if (cancelled_ || error_) {
+        return false;
+    }
+    // the buffer of the slot goes back to the inflater
+    qSwap(slot.data, *buffer);
+    slot.size = size;
+    slot.in_pos = in_pos;
+    slot.state = FULL;
+    data_ready_.wakeAll();
+    return true;
+}
+
+void GzipPipeline::finish(qint64 total) {
+    QMutexLocker locker(&mutex_);
+    total_ = total;
+    data_ready_.wakeAll();
+}
+
+void GzipPipeline::fail() {
+    QMutexLocker locker(&mutex_);
+    error_ = true;
+    slot_free_.wakeAll();
+    data_ready_.wakeAll();
+}
+
+void GzipPipeline::cancel() {
+    QMutexLocker locker(&mutex_);
+    cancelled_ = true;
+    slot_free_.wakeAll();
+    data_ready_.wakeAll();
+}
+
+bool GzipPipeline::failed() const {
+    QMutexLocker locker(&mutex_);
+    return error_;
+}
+
+bool GzipPipeline::next(Block* block) {
+    QMutexLocker locker(&mutex_);
+    while (true) {
+        if (cancelled_ || error_) {
+            return false;
+        }
+        if (total_ >= 0 && next_seq_ >= total_) {
+            if (carry_.isEmpty()) {
+                return false;
+            }
+            // the last line has no '\n'
+            block->joined = carry_;
+            block->data = 0;
+            block->size = 0;
+            block->slot = -1;
+            block->in_pos = in_pos_;
+            carry_.clear();
+            taken_ += 1;
+            return true;
+        }
+        int index = next_seq_ % slots_.size();
+        Slot& slot = slots_[index];
+        if (slot.seq != next_seq_ || slot.state != FULL) {
+            data_ready_.wait(&mutex_);
+            continue;
+        }
+        next_seq_ += 1;
+        in_pos_ = slot.in_pos;
+        const char* begin = slot.data.constData();
+        const char* end = begin + slot.size;
+        const char* first = (const char*)memchr(begin, '\n', end - begin);
+        if (!first) {
+            // a line longer than the chunk
+            carry_.append(begin, end - begin);
+            slot.state = EMPTY;
+            slot.seq += slots_.size();
+            slot_free_.wakeAll();
+            continue;
+        }
+        const char* last = end;
+        while (last[-1] != '\n') {
+            last--;
+        }
+        block->joined = carry_;
+        block->joined.append(begin, first + 1 - begin);
+        carry_ = QByteArray(last, end - last);
+        block->data = first + 1;
+        block->size = last - (first + 1);
+        block->slot = index;
+        block->in_pos = in_pos_;
+        slot.state = TAKEN;
+        taken_ += 1;
+        return true;
+    }
+}
+
+void GzipPipeline::release(const Block& block) {
+    QMutexLocker locker(&mutex_);
+    if (block.slot >= 0) {
+        Slot& slot = slots_[block.slot];
+        slot.state = EMPTY;
+        slot.seq += slots_.size();
+        slot_free_.wakeAll();
+    }
+    taken_ -= 1;
+    if (taken_ == 0) {
+        idle_.wakeAll();
+    }
+}
+
+void GzipPipeline::waitIdle() {
+    QMutexLocker locker(&mutex_);
+    while (taken_ > 0) {
+        idle_.wait(&mutex_);
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef GZIP_PIPELINE_H
+#define GZIP_PIPELINE_H
+
+#include <QtCore>
+
+// Inflates a gzip file ahead of its consumers.
+//
+// Inflater tasks fill a ring of large buffers in file order, consumers
+// take the buffers one by one and may process them concurrently. Every
+// block handed out holds complete lines only: the line cut by a buffer
+// boundary is glued from both buffers and handed out with the second one.
+//
+// Plain gzip files are inflated by one task. Block gzipped files (BGZF,
+// every member carries its compressed size in the "BC" extra field) are
+// split at member boundaries and inflated by a task per core.
+
+class GzipPipeline {
+public:
+    enum {
+        CHUNK_SIZE = 2 * 1024 * 1024
+    };
+
+    struct Block {
+        QByteArray joined; // the line cut by the buffer boundary, if any
+        const char* data;  // complete lines, valid until release()
+        int size;
+        int slot;
+        qint64 in_pos;     // compressed bytes read up to the end of the block
+    };
+
+    GzipPipeline(const QString& gz_path);
+    // cancels and waits for the inflaters
+    ~GzipPipeline();
+
+    // false if the file is not gzip
+    bool start();
+
+    bool isBlockGzip() const {
+        return bgzf_;
+    }
+
+    // waits for the next block; false at the end, on errors and after
+    // cancel(). Thread safe.
+    bool next(Block* block);
+    void release(const Block& block);
+    // waits until all blocks handed out are released
+    void waitIdle();
+    void cancel();
+
+    bool failed() const;
+
+private:
+    Q_DISABLE_COPY(GzipPipeline)
+
+    enum SlotState {
+        EMPTY,
+        FULL,
+        TAKEN
+    };
+
+    struct Slot {
+        QByteArray data;
+        int size;
+        qint64 in_pos;
+        qint64 seq;  // the only chunk which may occupy the slot now
+        SlotState state;
+    };
+
+    QString path_;
+    bool bgzf_;
+    QThreadPool pool_;
+
+    mutable QMutex mutex_;
+    QWaitCondition slot_free_;
+    QWaitCondition data_ready_;
+    QWaitCondition idle_;
+    QVector<Slot> slots_;
+    qint64 next_seq_;  // the chunk handed out next
+    qint64 total_;     // number of chunks, -1 until known
+    QByteArray carry_; // incomplete last line of the previous chunk
+    qint64 in_pos_;    // of the last chunk handed out
+    int taken_;
+    bool cancelled_;
+    bool error_;
+
+    // BGZF members are read in file order under read_mutex_
+    QMutex read_mutex_;
+    QFile file_;
+    qint64 next_batch_;
+    bool read_end_;
+
+    void inflateStream();
+    void inflateBlocks();
+    bool readBatch(QByteArray* compressed, int* size, qint64* in_pos, qint64* seq);
+    // swaps the filled buffer into the ring; false if cancelled
+    bool publish(qint64 seq, QByteArray* buffer, int size, qint64 in_pos);
+    void finish(qint64 total);
+    void fail();
+
+    friend class InflateTask;
+};
+
+#endif // GZIP_PIPELINE_H
@@ -0,0 +1,185 @@
+#include "hash_index.h"
+#include <algorithm>
+#include <climits>
+#include "dump_line.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+const char HASH_INDEX_MAGIC[8] = {'D', 'V', 'H', 'A', 'S', 'H', '0', '1'};
+
+struct HashIndexHeader {
+    char magic[8];
+    qint64 dump_size;
+    qint64 dump_mtime;
+    quint64 count;
+};
+
+// hashes first, then offsets aligned to 8 bytes
+qint64 offsetsPos(quint64 count) {
+    qint64 end = sizeof(HashIndexHeader) + count * HashIndex::HASH_SIZE;
+    return (end + 7) / 8 * 8;
+}
+
+} // end of anonymous namespace
+
+bool HashIndexBuilder::Entry::operator<(const Entry& other) const {
+    int c = memcmp(hash, other.hash, HashIndex::HASH_SIZE);
+    return c < 0 || (c == 0 && offset < other.offset);
+}
+
+void HashIndexBuilder::addRecord(qint64 offset, const char* line, int size) {
+    RecordFields fields;
+    if (!splitRecord(line, size, &fields)) {
+        return;
+    }
+    QByteArray hash = torrent_hash_bytes(QString::fromLatin1(fields.begin[FIELD_HASH],
+                                                             fields.size[FIELD_HASH]));
+    if (hash.size() != HashIndex::HASH_SIZE) {
+        return;
+    }
+    Entry entry;
+    memcpy(entry.hash, hash.constData(), HashIndex::HASH_SIZE);
+    entry.offset = offset;
+    entries_ << entry;
+}
+
+bool HashIndexBuilder::save(const QString& index_path, const QFileInfo& dump) {
+    std::sort(entries_.begin(), entries_.end());
+    HashIndexHeader header;
+    memcpy(header.magic, HASH_INDEX_MAGIC, sizeof(header.magic));
+    header.dump_size = dump.size();
+    header.dump_mtime = dump.lastModified().toTime_t();
+    header.count = entries_.size();
+
+    QString tmp_path = index_path + ".tmp";
+    QFile out(tmp_path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write hash index" << tmp_path;
+        return false;
+    }
+    QByteArray hashes;
+    hashes.reserve(entries_.size() * HashIndex::HASH_SIZE);
+    QVector<qint64> offsets;
+    offsets.reserve(entries_.size());
+    foreach (const Entry& entry, entries_) {
+        hashes.append(entry.hash, HashIndex::HASH_SIZE);
+        offsets << entry.offset;
+    }
+    int padding = offsetsPos(header.count) - sizeof(header) - hashes.size();
+    hashes.append(QByteArray(padding, '\0'));
+    qint64 offsets_bytes = offsets.size() * sizeof(qint64);
+    bool ok = out.write((const char*)&header, sizeof(header)) == sizeof(header) &&
+              out.write(hashes) == hashes.size() &&
+              out.write((const char*)offsets.constData(), offsets_bytes) == offsets_bytes;
+    out.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(index_path);
+    return QFile::rename(tmp_path, index_path);
+}
+
+HashIndex::HashIndex():
+    map_(0), count_(0), hashes_(0), offsets_(0) {
+}
+
+HashIndex::~HashIndex() {
+    close();
+}
+
+QString HashIndex::indexPath(const QString& dump_path) {
+    return dump_path + ".hashes";
+}
+
+QByteArray HashIndex::parseHash(const QString& text) {
+    static const QRegExp HEX("[0-9A-Fa-f]{40}");
+    static const QRegExp BASE32("[A-Za-z2-7]{32}");
+    static const QRegExp MAGNET("xt=urn:btih:([0-9A-Za-z]+)");
+    // copies per call, matching keeps state in the object
+    QRegExp hex = HEX;
+    QRegExp base32 = BASE32;
+    QRegExp magnet = MAGNET;
+    QString hash = text.trimmed();
+    if (magnet.indexIn(hash) >= 0) {
+        hash = magnet.cap(1);
+    }
+    if (hex.exactMatch(hash)) {
+        return torrent_hash_bytes(hash);
+    }
+    if (base32.exactMatch(hash)) {
+        return torrent_hash_bytes(hash.toUpper());
+    }
+    return QByteArray();
+}
+
+bool HashIndex::open(const QString& dump_path) {
+    close();
+    QFileInfo dump(dump_path);
+    file_.setFileName(indexPath(dump_path));
+    if (!dump.exists() || !file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file_.size();
+    if (size < qint64(sizeof(HashIndexHeader))) {
+        file_.close();
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (!map_) {
+        file_.close();
+        return false;
+    }
+    const HashIndexHeader* header = reinterpret_cast<const HashIndexHeader*>(map_);
+    bool valid = memcmp(header->magic, HASH_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->dump_size == dump.size() &&
+                 header->dump_mtime == qint64(dump.lastModified().toTime_t()) &&
+                 header->count < quint64(INT_MAX) &&
+                 offsetsPos(header->count) + qint64(header->count * sizeof(qint64)) == size;
+    if (!valid) {
+        qDebug() << "stale or broken hash index" << file_.fileName();
+        close();
+        return false;
+    }
+    count_ = header->count;
+    hashes_ = reinterpret_cast<const char*>(map_ + sizeof(HashIndexHeader));
+    offsets_ = reinterpret_cast<const qint64*>(map_ + offsetsPos(header->count));
+    return true;
+}
+
+void HashIndex::close() {
+    if (map_) {
+        file_.unmap(map_);
+        map_ = 0;
+    }
+    if (file_.isOpen()) {
+        file_.close();
+    }
+    count_ = 0;
+    hashes_ = 0;
+    offsets_ = 0;
+}
+
+QVector<qint64> HashIndex::find(const QByteArray& hash) const {
+    QVector<qint64> offsets;
+    if (hash.size() != HASH_SIZE || !map_) {
+        return offsets;
+    }
+    // the first entry not less than the hash
+    int begin = 0;
+    int end = count_;
+    while (begin < end) {
+        int middle = begin + (end - begin) / 2;
+        if (memcmp(hashes_ + qint64(middle) * HASH_SIZE, hash.constData(), HASH_SIZE) < 0) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    for (int i = begin; i < count_ &&
+            memcmp(hashes_ + qint64(i) * HASH_SIZE, hash.constData(), HASH_SIZE) == 0; i++) {
+        offsets << offsets_[i];
+    }
+    return offsets;
+}
@@ -0,0 +1,69 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <QtCore>
+
+// Info-hashes of final.txt, sorted (final.txt.hashes).
+//
+// The 20 byte hashes are one column and the offsets of their lines in the
+// uncompressed dump another, so a lookup is a binary search over the
+// mapped hash column.
+
+class HashIndexBuilder {
+public:
+    // raw dump line at offset, skipped if it is not a record
+    void addRecord(qint64 offset, const char* line, int size);
+
+    bool save(const QString& index_path, const QFileInfo& dump);
+
+private:
+    struct Entry {
+        char hash[20];
+        qint64 offset;
+
+        bool operator<(const Entry& other) const;
+    };
+
+    QVector<Entry> entries_;
+};
+
+class HashIndex {
+public:
+    enum {
+        HASH_SIZE = 20
+    };
+
+    HashIndex();
+    ~HashIndex();
+
+    static QString indexPath(const QString& dump_path);
+
+    // 20 bytes of a hex or base32 hash or of the hash of a magnet link,
+    // empty if text is none of them
+    static QByteArray parseHash(const QString& text);
+
+    // maps the index of dump_path; fails if it is missing or stale
+    bool open(const QString& dump_path);
+    void close();
+    bool isOpen() const {
+        return map_ != 0;
+    }
+
+    int size() const {
+        return count_;
+    }
+
+    // offsets of the lines with the hash, in file order
+    QVector<qint64> find(const QByteArray& hash) const;
+
+private:
+    Q_DISABLE_COPY(HashIndex)
+
+    QFile file_;
+    uchar* map_;
+    int count_;
+    const char* hashes_;
+    const qint64* offsets_;
+};
+
+#endif // HASH_INDEX_H
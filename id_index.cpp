@@ -0,0 +1,186 @@
+#include "id_index.h"
+#include <cstring>
+#include "dump_line.h"
+
+namespace {
+
+const char ID_INDEX_MAGIC[8] = {'D', 'V', 'I', 'D', 'S', '0', '0', '1'};
+// 256 MB of offsets, several times the ids rutracker has given out
+const int MAX_SPAN = 32 * 1024 * 1024;
+
+struct IdIndexHeader {
+    char magic[8];
+    qint64 source_size;
+    qint64 source_mtime;
+    qint32 min_id;
+    qint32 count;
+};
+
+} // end of anonymous namespace
+
+IdIndexBuilder::IdIndexBuilder():
+    min_id_(0), skipped_(0) {
+}
+
+void IdIndexBuilder::add(int id, qint64 offset) {
+    if (id < 0) {
+        return;
+    }
+    if (!offsets_.isEmpty()) {
+        qint64 low = qMin(min_id_, id);
+        qint64 high = qMax(qint64(min_id_) + offsets_.size() - 1, qint64(id));
+        if (high - low >= MAX_SPAN) {
+            skipped_ += 1;
+            return;
+        }
+    }
+    if (offsets_.isEmpty()) {
+        min_id_ = id;
+    } else if (id < min_id_) {
+        // rare: ids mostly come in ascending order
+        QVector<qint64> offsets(offsets_.size() + (min_id_ - id), -1);
+        qCopy(offsets_.constBegin(), offsets_.constEnd(), offsets.begin() + (min_id_ - id));
+        offsets_ = offsets;
+        min_id_ = id;
+    }
+    int i = id - min_id_;
+    if (i >= offsets_.size()) {
+        int old_size = offsets_.size();
+        offsets_.resize(i + 1);
+        qFill(offsets_.begin() + old_size, offsets_.end(), qint64(-1));
+    }
+    offsets_[i] = offset;
+}
+
+void IdIndexBuilder::addRecord(qint64 offset, const char* line, int size) {
+    RecordFields fields;
+    if (!splitRecord(line, size, &fields)) {
+        return;
+    }
+    bool ok;
+    int id = fields.field(FIELD_ID).toInt(&ok);
+    if (ok) {
+        add(id, offset);
+    }
+}
+
+bool IdIndexBuilder::save(const QString& index_path, const QFileInfo& source) const {
+    if (!source.exists()) {
+        return false;
+    }
+    return save(index_path, source.size(), source.lastModified().toTime_t());
+}
+
+bool IdIndexBuilder::save(const QString& index_path, qint64 source_size,
+                          qint64 source_mtime) const {
+    if (skipped_ > 0) {
+        qDebug() << "ids span too far, no id index:" << skipped_ << "skipped";
+        QFile::remove(index_path);
+        return true;
+    }
+    IdIndexHeader header;
+    memcpy(header.magic, ID_INDEX_MAGIC, sizeof(header.magic));
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.min_id = min_id_;
+    header.count = offsets_.size();
+
+    QString tmp_path = index_path + ".tmp";
+    QFile out(tmp_path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write id index" << tmp_path;
+        return false;
+    }
+    qint64 bytes = offsets_.size() * sizeof(qint64);
+    bool ok = out.write((const char*)&header, sizeof(header)) == sizeof(header) &&
+              out.write((const char*)offsets_.constData(), bytes) == bytes;
+    out.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(index_path);
+    return QFile::rename(tmp_path, index_path);
+}
+
+IdIndex::IdIndex():
+    map_(0), min_id_(0), count_(0), offsets_(0) {
+}
+
+IdIndex::~IdIndex() {
+    close();
+}
+
+QString IdIndex::dumpIndexPath(const QString& dump_path) {
+    return dump_path + ".ids";
+}
+
+QString IdIndex::descriptionsIndexPath(const QString& root) {
+    return QDir(root).absoluteFilePath("descriptions.ids");
+}
+
+int IdIndex::parseTopicId(const QString& text) {
+    static const QRegExp ID("(?:id:|viewtopic\\.php\\?t=)(\\d+)");
+    // a copy per call, matching keeps state in the object
+    QRegExp id_rx = ID;
+    QString query = text.trimmed();
+    if (id_rx.indexIn(query) < 0) {
+        return -1;
+    }
+    bool ok;
+    int id = id_rx.cap(1).toInt(&ok);
+    return ok ? id : -1;
+}
+
+bool IdIndex::open(const QString& index_path, const QFileInfo& source) {
+    if (!source.exists()) {
+        close();
+        return false;
+    }
+    return open(index_path, source.size(), source.lastModified().toTime_t());
+}
+
+bool IdIndex::open(const QString& index_path, qint64 source_size, qint64 source_mtime) {
+    close();
+    file_.setFileName(index_path);
+    if (!file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file_.size();
+    if (size < qint64(sizeof(IdIndexHeader))) {
+        file_.close();
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (!map_) {
+        file_.close();
+        return false;
+    }
+    const IdIndexHeader* header = reinterpret_cast<const IdIndexHeader*>(map_);
+    bool fresh = header->source_size == source_size && header->source_mtime == source_mtime;
+    bool valid = memcmp(header->magic, ID_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                 fresh && header->min_id >= 0 && header->count >= 0 &&
+                 qint64(sizeof(IdIndexHeader)) + header->count * qint64(sizeof(qint64)) == size;
+    if (!valid) {
+        qDebug() << "stale or broken id index" << index_path;
+        close();
+        return false;
+    }
+    min_id_ = header->min_id;
+    count_ = header->count;
+    offsets_ = reinterpret_cast<const qint64*>(map_ + sizeof(IdIndexHeader));
+    return true;
+}
+
+void IdIndex::close() {
+    if (map_) {
+        file_.unmap(map_);
+        map_ = 0;
+    }
+    if (file_.isOpen()) {
+        file_.close();
+    }
+    min_id_ = 0;
+    count_ = 0;
+    offsets_ = 0;
+}
@@ -0,0 +1,79 @@
+#ifndef ID_INDEX_H
+#define ID_INDEX_H
+
+#include <QtCore>
+
+// Dense table from topic id to an offset, kept next to the file it
+// describes: final.txt.ids maps ids to line offsets of the dump and
+// descriptions.ids maps ids to offsets in their description archives.
+//
+// Topic ids are dense, so the table is a plain array of offsets from the
+// smallest id to the largest one, -1 where there is no topic. A lookup is
+// one read of the mapped array. An id far from the others would blow the
+// array up, so the span is capped; a table which would miss the ids beyond
+// the cap is not written at all and lookups fall back to scanning.
+
+class IdIndexBuilder {
+public:
+    IdIndexBuilder();
+
+    void add(int id, qint64 offset);
+    // raw dump line at offset, skipped if it is not a record
+    void addRecord(qint64 offset, const char* line, int size);
+
+    // size and mtime of the source are checked on open; with ids skipped
+    // by the span cap the table is removed instead
+    bool save(const QString& index_path, const QFileInfo& source) const;
+    // a source which is not one file passes numbers standing for its state
+    bool save(const QString& index_path, qint64 source_size, qint64 source_mtime) const;
+
+private:
+    QVector<qint64> offsets_; // from min_id_
+    int min_id_;
+    int skipped_; // ids beyond the span cap
+
+    friend class IdIndex;
+};
+
+class IdIndex {
+public:
+    IdIndex();
+    ~IdIndex();
+
+    static QString dumpIndexPath(const QString& dump_path);
+    static QString descriptionsIndexPath(const QString& root);
+
+    // topic id of "id:123" or of a rutracker topic link, -1 otherwise
+    static int parseTopicId(const QString& text);
+
+    // maps the table; fails if it is missing or stale
+    bool open(const QString& index_path, const QFileInfo& source);
+    bool open(const QString& index_path, qint64 source_size, qint64 source_mtime);
+    void close();
+    bool isOpen() const {
+        return map_ != 0;
+    }
+
+    // -1 if there is no such topic
+    qint64 offset(int id) const {
+        qint64 i = qint64(id) - min_id_;
+        return i >= 0 && i < count_ ? offsets_[i] : -1;
+    }
+
+    bool contains(int id) const {
+        return offset(id) >= 0;
+    }
+
+private:
+    Q_DISABLE_COPY(IdIndex)
+
+    QFile file_;
+    uchar* map_;
+    int min_id_;
+    int count_;
+    const qint64* offsets_;
+};
+
+typedef QSharedPointer<IdIndex> IdIndex_ptr;
+
+#endif // ID_INDEX_H
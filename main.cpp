@@ -1,8 +1,23 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "console_search.h"
+#include "query_server.h"
 
 int main(int argc, char *argv[])
 {
+    QStringList args;
+    for (int i = 1; i < argc; i++) {
+        args << QString::fromLocal8Bit(argv[i]);
+    }
+    // no widgets in the headless modes, so they run without a display
+    if (isConsoleSearch(args)) {
+        QCoreApplication a(argc, argv);
+        return runConsoleSearch(args);
+    }
+    if (isQueryServer(args)) {
+        QCoreApplication a(argc, argv);
+        return runQueryServer(args);
+    }
     QApplication a(argc, argv);
     a.setOrganizationName("ratnik");
     a.setOrganizationDomain("rutracker.org");
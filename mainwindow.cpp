@@ -1,93 +1,23 @@
 #include <QtCore>
 #include <QtGui>
 #include <QtWebKit>
+#include <climits>
 #include <kfilterdev.h>
 #include <ktar.h>
-#include <zlib.h>
-#include "Archive.h"
-#include "ArchiveImpl.h"
 #include "quazip/quagzipfile.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "torrent_hash_convert.h"
+#include "dump_indexer.h"
+#include "unpacking_thread.h"
+#include "results_model.h"
+#include "description_archive.h"
+#include "description_loader.h"
+#include "description_store.h"
+#include "hash_index.h"
+#include "id_index.h"
+#include "dump_line.h"
 
-enum {
-    COLUMN_ID,
-    COLUMN_NAME,
-    COLUMN_SIZE,
-    COLUMN_SEEDS,
-    COLUMN_LEECHES,
-    COLUMN_HASH,
-    COLUMN_DOWNLOADS,
-    COLUMN_UPDATED
-};
-QByteArray gUncompress(const QByteArray &data)
-{
-    if(data.size()<=4){
-        qWarning("gUncompress: Input data is truncated");
-        return QByteArray();
-    }
-    QByteArray result;
-
-    int ret;
-    z_stream strm;
-    static const int CHUNK_SIZE = 1024;
-    char out[CHUNK_SIZE];
-
-    /* allocate inflate state */
-    strm.zalloc=Z_NULL;
-    strm.zfree=Z_NULL;
-    strm.opaque=Z_NULL;
-    strm.avail_in=data.size();
-    strm.next_in=(Bytef*)(data.data());
-
-    ret=inflateInit2(&strm,15+32); // gzip decoding
-    if(ret!=Z_OK)
-        return QByteArray();
-
-    // run inflate()
-    do{
-        strm.avail_out=CHUNK_SIZE;
-        strm.next_out=(Bytef*)(out);
-
-        ret=inflate(&strm, Z_NO_FLUSH);
-        Q_ASSERT(ret!=Z_STREAM_ERROR);  // state not clobbered
-
-        switch(ret){
-            case Z_NEED_DICT:
-                ret = Z_DATA_ERROR;     // and fall through
-            case Z_DATA_ERROR:
-            case Z_MEM_ERROR:
-                (void)inflateEnd(&strm);
-                return QByteArray();
-        }
-        result.append(out,CHUNK_SIZE-strm.avail_out);
-    } while(strm.avail_out==0);
-
-    // clean up and return
-    inflateEnd(&strm);
-    return result;
-}
-bool gUncompress(QFile* in,QFile* out)
-{
-        if(!in->open(QIODevice::ReadOnly)||!out->open(QIODevice::WriteOnly|QIODevice::Truncate))
-            return false;
-        gzFile gz=gzdopen(in->handle(),"rb");
-        if(gz==NULL)
-            return false;
-
-        static const int buffer_size = 0x40000;
-        char buffer[buffer_size];
-        memset(buffer,0,buffer_size);
-        int read=0;
-        do{
-            out->write(QByteArray(buffer,read*sizeof(char)));
-            read=qMin(gzread(gz,buffer,buffer_size),buffer_size);
-        } while(read>0);
-        gzclose(gz);
-
-        return true;
-}
 MainWindow* mainWindow() {
     return static_cast<MainWindow*>(QApplication::activeWindow());
 }
@@ -103,37 +33,10 @@ QString magnetUrl(QString hash, QString name, qlonglong size, bool urlencode) {
 }
 
 
-class IDItem : public QTableWidgetItem {
-public:
-    IDItem(int id):
-        id_(id) {
-        setData(Qt::DisplayRole, id);
-        setData(Qt::ForegroundRole, Qt::blue);
-        setFlags(flags() & ~Qt::ItemIsSelectable);
-    }
-
-    bool operator<(const QTableWidgetItem& other) const {
-        const IDItem* other_sized = dynamic_cast<const IDItem*>(&other);
-        if (other_sized) {
-            return id_ < other_sized->id_;
-        } else {
-            return this->QTableWidgetItem::operator<(other);
-        }
-    }
-
-    qlonglong id() const {
-        return id_;
-    }
-    friend class IDDelegate;
-    friend class MainWindow;
-private:
-    qlonglong id_;
-};
-
 class IDDelegate : public QItemDelegate {
 public:
-    IDDelegate(QTableWidget* table, QObject* parent = 0):
-        QItemDelegate(parent), table_(table) {
+    IDDelegate(ResultsModel* results, QObject* parent = 0):
+        QItemDelegate(parent), results_(results) {
     }
 
     bool editorEvent(QEvent* event, QAbstractItemModel*,
@@ -142,65 +45,27 @@ public:
         if (event->type() == QEvent::MouseButtonPress) {
             QMouseEvent* e = dynamic_cast<QMouseEvent*>(event);
             if (e) {
-                int row = index.row();
-                int col = COLUMN_ID;
-                IDItem* item = dynamic_cast<IDItem*>(table_->item(row, col));
-                if (item) {
-                    int id = item->id_;
-                    QString url = rutrackerUrl(id);
-                    if (e->button() == Qt::LeftButton) {
-                        mainWindow()->openUrl(url);
-                    } else if (e->button() == Qt::RightButton) {
-                        QApplication::clipboard()->setText(url);
-                    }
-                    return true;
+                int id = results_->id(index.row());
+                QString url = rutrackerUrl(id);
+                if (e->button() == Qt::LeftButton) {
+                    mainWindow()->openUrl(url);
+                } else if (e->button() == Qt::RightButton) {
+                    QApplication::clipboard()->setText(url);
                 }
+                return true;
             }
         }
         return false;
     }
 
 private:
-    QTableWidget* table_;
-};
-
-class HashItem : public QTableWidgetItem {
-public:
-    HashItem(QString hash, QString name, qlonglong size):
-        base32_hash_(torrent_hash_convert(hash, /*base32*/ true)),
-        name_(name), size_(size) {
-        updateHash();
-        setData(Qt::ForegroundRole, Qt::blue);
-        setFlags(flags() & ~Qt::ItemIsSelectable);
-    }
-
-    void updateHash() {
-        QString h = hash();
-        setData(Qt::DisplayRole, h);
-    }
-
-    QString hash() {
-        MainWindow* w = mainWindow();
-        if (w && w->useBase32()) {
-            return base32_hash_; // base32
-        } else {
-            return torrent_hash_convert(base32_hash_, /*base32*/ false); // hex
-        }
-    }
-
-    friend class HashDelegate;
-    friend class MainWindow;
-
-private:
-    QString base32_hash_; // base32
-    QString name_;
-    qlonglong size_;
+    ResultsModel* results_;
 };
 
 class HashDelegate : public QItemDelegate {
 public:
-    HashDelegate(QTableWidget* table, QObject* parent = 0):
-        QItemDelegate(parent), table_(table) {
+    HashDelegate(ResultsModel* results, QObject* parent = 0):
+        QItemDelegate(parent), results_(results) {
     }
 
     bool editorEvent(QEvent* event, QAbstractItemModel*,
@@ -210,82 +75,26 @@ public:
             QMouseEvent* e = dynamic_cast<QMouseEvent*>(event);
             if (e) {
                 int row = index.row();
-                int col = COLUMN_HASH;
-                HashItem* item = dynamic_cast<HashItem*>(table_->item(row, col));
-                if (item) {
-                    if (e->button() == Qt::LeftButton) {
-                        QString url = magnetUrl(item->hash(), item->name_, item->size_, false);
-                        QDesktopServices::openUrl(url);
-                    } else if (e->button() == Qt::RightButton) {
-                        QString url = magnetUrl(item->hash(), item->name_, item->size_, true);
-                        QApplication::clipboard()->setText(url);
-                    }
-                    return true;
+                QString hash = results_->hash(row);
+                QString name = results_->name(row);
+                qlonglong size = results_->torrentSize(row);
+                if (e->button() == Qt::LeftButton) {
+                    QString url = magnetUrl(hash, name, size, false);
+                    QDesktopServices::openUrl(url);
+                } else if (e->button() == Qt::RightButton) {
+                    QString url = magnetUrl(hash, name, size, true);
+                    QApplication::clipboard()->setText(url);
                 }
+                return true;
             }
         }
         return false;
     }
 
 private:
-    QTableWidget* table_;
+    ResultsModel* results_;
 };
 
-SearchingThread::SearchingThread(QIODevice* input, MainWindow* window,
-                                 int limit, QString pattern, bool cp1251):
-    input_(input), window_(window),
-    limit_(limit), pattern_(pattern), cp1251_(cp1251) {
-}
-
-void SearchingThread::run() {
-    QTextStream in(input_);
-    if (cp1251_) {
-        in.setCodec(QTextCodec::codecForName("Windows-1251"));
-    } else {
-        in.setCodec(QTextCodec::codecForName("UTF-8"));
-    }
-    if (limit_ <= 0) {
-        emit stopFilling();
-        return;
-    }
-    int hits = 0;
-    QStringList_ptr chunk(new QStringList);
-    QByteArray line_byte;
-    while(0!=(line_byte=input_->readLine())) {
-        if (!window_->keepSearching()) {
-            emit newLines(chunk);
-            chunk = QStringList_ptr(new QStringList);
-            emit stopFilling();
-            return;
-        }
-        QString line=QString::fromUtf8(line_byte);
-        QStringList fields = line.split('\t');
-        if (fields.size() != 8) {
-            fields = line.split('|');
-        }
-        if (fields.size() < 8) {
-            continue;
-        }
-        QString name = fields[1];
-        if (name.contains(pattern_, Qt::CaseInsensitive)) {
-            (*chunk) << line;
-            hits += 1;
-            if (hits >= limit_) {
-                emit newLines(chunk);
-                chunk = QStringList_ptr(new QStringList);
-                emit stopFilling();
-                return;
-            }
-            if (chunk->size() >= 5) {
-                emit newLines(chunk);
-                chunk = QStringList_ptr(new QStringList);
-            }
-        }
-    }
-    emit newLines(chunk);
-    emit stopFilling();
-}
-
 QDir appDir() {
     return QFileInfo(QCoreApplication::applicationFilePath()).absoluteDir();
 }
@@ -294,18 +103,46 @@ QString settingsPath() {
     return appDir().absoluteFilePath("dump_viewer.ini");
 }
 
+// the numeric field of dump_line.h shown in the column, -1 for text
+int columnField(int column) {
+    switch (column) {
+    case COLUMN_ID:
+        return FIELD_ID;
+    case COLUMN_SIZE:
+        return FIELD_SIZE;
+    case COLUMN_SEEDS:
+        return FIELD_SEEDS;
+    case COLUMN_LEECHES:
+        return FIELD_LEECHES;
+    case COLUMN_DOWNLOADS:
+        return FIELD_DOWNLOADS;
+    case COLUMN_UPDATED:
+        return FIELD_UPDATED;
+    }
+    return -1;
+}
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    keepSearching_(false),
     settings_(settingsPath(), QSettings::IniFormat),
-    useBase32_(false)
+    useBase32_(false),
+    results_(new ResultsModel(this)),
+    prefetchTimer_(new QTimer(this)),
+    prefetchRows_(DEFAULT_PREFETCH_ROWS),
+    search_(0),
+    drainTimer_(new QTimer(this)),
+    drainRows_(MIN_DRAIN_ROWS),
+    typingTimer_(new QTimer(this)),
+    searchLimit_(0),
+    searchedAll_(false)
 {
-    qRegisterMetaType<QStringList_ptr>("QStringList_ptr");
+    qRegisterMetaType<ResultStore_ptr>("ResultStore_ptr");
     ui->setupUi(this);
-    QTableWidget* table = ui->resultsTableWidget;
-    table->setItemDelegateForColumn(COLUMN_ID, new IDDelegate(table, this));
-    table->setItemDelegateForColumn(COLUMN_HASH, new HashDelegate(table, this));
+    QTableView* table = ui->resultsTableView;
+    table->setModel(results_);
+    table->setItemDelegateForColumn(COLUMN_ID, new IDDelegate(results_, this));
+    table->setItemDelegateForColumn(COLUMN_HASH, new HashDelegate(results_, this));
     table->resizeColumnsToContents();
     table->setSortingEnabled(true);
     table->sortByColumn(COLUMN_DOWNLOADS, Qt::DescendingOrder);
@@ -318,7 +155,11 @@ MainWindow::MainWindow(QWidget *parent) :
     if (settings().contains("use_base32")) {
         useBase32_ = settings().value("use_base32").toBool();
     }
+    if (settings().contains("description_cache_mb")) {
+        descriptions_.setBudget(settings().value("description_cache_mb").toInt());
+    }
     ui->base32Action->setChecked(useBase32());
+    results_->setBase32(useBase32());
     table->resizeColumnsToContents();
     table->setColumnWidth(COLUMN_ID, table->columnWidth(COLUMN_ID) + 10);
     table->setColumnWidth(COLUMN_HASH, 150);
@@ -335,110 +176,165 @@ MainWindow::MainWindow(QWidget *parent) :
     table->addAction(ui->action_open_magnet);
     QWebSettings* ws = ui->descriptionWebView->settings();
     ws->setAttribute(QWebSettings::JavascriptEnabled, false);
+    descriptionPool_.setMaxThreadCount(2);
+    openDescriptionSource();
+    if (settings().contains("prefetch_rows")) {
+        prefetchRows_ = settings().value("prefetch_rows").toInt();
+    }
+    prefetchTimer_->setSingleShot(true);
+    prefetchTimer_->setInterval(100);
+    connect(prefetchTimer_, SIGNAL(timeout()),
+            this, SLOT(prefetchDescriptions()));
+    connect(table->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            prefetchTimer_, SLOT(start()));
+    drainTimer_->setInterval(DRAIN_INTERVAL_MS);
+    connect(drainTimer_, SIGNAL(timeout()),
+            this, SLOT(drainResults()));
+    typingTimer_->setSingleShot(true);
+    typingTimer_->setInterval(TYPING_DELAY_MS);
+    connect(typingTimer_, SIGNAL(timeout()),
+            this, SLOT(search()));
 }
 
 MainWindow::~MainWindow()
 {
+    if (search_) {
+        search_->stop();
+    }
+    stopDescriptionJobs();
     delete ui;
 }
 
 void MainWindow::startFilling() {
-    QTableWidget* table = ui->resultsTableWidget;
-    table->clearContents();
-    table->setRowCount(0);
+    QTableView* table = ui->resultsTableView;
+    results_->clear();
     table->setSortingEnabled(false);
-    keepSearching_ = true;
+    drainTimer_->start();
     updateButtons();
 }
 
 void MainWindow::stopFilling() {
-    QTableWidget* table = ui->resultsTableWidget;
+    QTableView* table = ui->resultsTableView;
     table->setSortingEnabled(true);
-    keepSearching_ = false;
+    drainTimer_->stop();
+    searchRing_.clear();
     updateButtons();
+    prefetchTimer_->start();
 }
 
-void MainWindow::showDescription(int id) {
-    qDebug() << "showDescription " << id;
-    QString description = descriptionById(id);
-    ui->descriptionWebView->setHtml(description);
+// stopFilling is the last signal of a search, everything it pushed into
+// the ring is there by now
+void MainWindow::searchFinished() {
+    QObject* finished = sender();
+    finished->deleteLater();
+    if (finished != search_) {
+        return;
+    }
+    bool broken = search_->broken();
+    search_ = 0;
+    takeResults(INT_MAX);
+    searchedAll_ = !broken && !searchedPattern_.isNull() &&
+                   results_->rowCount() < searchLimit_;
+    stopFilling();
+    if (broken) {
+        QErrorMessage::qtHandler()->showMessage(tr("Error reading database file!"));
+    }
 }
 
-void MainWindow::rowChanged(QModelIndex current) {
-    QTableWidget* table = ui->resultsTableWidget;
-    int row = current.row();
-    int column = COLUMN_ID;
-    QTableWidgetItem* item = table->item(row, column);
-    IDItem* id_item = dynamic_cast<IDItem*>(item);
-    if (id_item) {
-        showDescription(id_item->id());
+void MainWindow::cancelSearch() {
+    typingTimer_->stop();
+    if (search_) {
+        search_->stop();
+        search_ = 0;
+        stopFilling();
     }
 }
 
-QString fileSize(qlonglong size) {
-    if (size > 1024 * 1024 * 1024) {
-        size /= 1024 * 1024 * 1024;
-        return QString::number(size) + " GB";
+bool MainWindow::refineSearch(const QString& pattern) {
+    if (search_ || !searchedAll_ || searchedSource_ != searchSource() ||
+        results_->rowCount() > ui->limitSpinBox->value()) {
+        return false;
     }
-    if (size > 1024 * 1024) {
-        size /= 1024 * 1024;
-        return QString::number(size) + " MB";
+    // the table holds UTF-8 names whatever the dump encoding
+    SearchQuery query(pattern);
+    if (!query.refines(SearchQuery(searchedPattern_))) {
+        return false;
     }
-    if (size > 1024) {
-        size /= 1024;
-        return QString::number(size) + " kB";
+    results_->filter(query);
+    searchedPattern_ = pattern;
+    settings().setValue("pattern", pattern);
+    return true;
+}
+
+QString MainWindow::searchSource() {
+    return inputPath() + (settings().value("cp1251").toBool() ? "|cp1251" : "");
+}
+
+void MainWindow::showDescription(int id) {
+    qDebug() << "showDescription " << id;
+    // supersedes the fetch in flight, if any
+    int request = descriptionRequest_.fetchAndAddOrdered(1) + 1;
+    QString description;
+    if (descriptions_.description(id, &description)) {
+        ui->descriptionWebView->setHtml(description);
+        return;
     }
-    return QString::number(size) + " B";
+    DescriptionThread* thread = new DescriptionThread(descriptionSource(), id,
+            &descriptionRequest_, request);
+    connect(thread, SIGNAL(loaded(int, QString)),
+            this, SLOT(descriptionLoaded(int, QString)),
+            Qt::QueuedConnection);
+    descriptionPool_.start(thread);
 }
 
-QDateTime parseUpdated(QString text) {
-    text.replace("Jan", "01");
-    text.replace("Feb", "02");
-    text.replace("Mar", "03");
-    text.replace("Apr", "04");
-    text.replace("May", "05");
-    text.replace("Jun", "06");
-    text.replace("Jul", "07");
-    text.replace("Aug", "08");
-    text.replace("Sep", "09");
-    text.replace("Oct", "10");
-    text.replace("Nov", "11");
-    text.replace("Dec", "12");
-    QDateTime datetime = QDateTime::fromString(text, "dd-MM-yy HH:mm");
-    if (datetime.date().year() < 2000) {
-        // shit like 1909 on place of 2009
-        datetime = datetime.addYears(100);
+void MainWindow::prefetchDescriptions() {
+    // supersedes prefetching of rows no longer in view
+    int request = prefetchRequest_.fetchAndAddOrdered(1) + 1;
+    QTableView* table = ui->resultsTableView;
+    int rows = results_->rowCount();
+    if (rows == 0) {
+        return;
+    }
+    int first = qMax(table->rowAt(0), 0);
+    int last = table->rowAt(table->viewport()->height() - 1);
+    if (last < 0) {
+        last = rows - 1;
+    }
+    last = qMin(last + prefetchRows_, rows - 1);
+    // one job per archive, so it is inflated once
+    QMap<QString, QList<int> > buckets;
+    for (int row = first; row <= last; row++) {
+        int id = results_->id(row);
+        buckets[descriptionBucket(id)] << id;
+    }
+    DescriptionSource source = descriptionSource();
+    foreach (const QList<int>& ids, buckets) {
+        DescriptionPrefetchThread* thread = new DescriptionPrefetchThread(source, ids,
+                &prefetchRequest_, request);
+        descriptionPool_.start(thread, PREFETCH_PRIORITY);
     }
-    return datetime;
 }
 
-class SizeItem : public QTableWidgetItem {
-public:
-    SizeItem(qlonglong size):
-        size_(size) {
-        setData(Qt::ToolTipRole, size);
-        setData(Qt::DisplayRole, fileSize(size));
-    }
-
-    bool operator<(const QTableWidgetItem& other) const {
-        const SizeItem* other_sized = dynamic_cast<const SizeItem*>(&other);
-        if (other_sized) {
-            return size_ < other_sized->size_;
-        } else {
-            return this->QTableWidgetItem::operator<(other);
-        }
+void MainWindow::descriptionLoaded(int id, QString description) {
+    int row = currentRow();
+    if (row >= 0 && results_->id(row) == id) {
+        ui->descriptionWebView->setHtml(description);
     }
+}
 
-private:
-    qlonglong size_;
-};
+void MainWindow::rowChanged(QModelIndex current) {
+    int row = current.row();
+    if (row >= 0 && row < results_->rowCount()) {
+        showDescription(results_->id(row));
+    }
+}
 
 void MainWindow::on_searchButton_clicked() {
     search();
 }
 
 void MainWindow::on_stopButton_clicked() {
-    stopFilling();
+    cancelSearch();
 }
 
 void MainWindow::on_exitAction_triggered() {
@@ -459,14 +355,7 @@ void MainWindow::on_selectAction_triggered() {
 void MainWindow::on_base32Action_triggered(bool base32) {
     useBase32_ = base32;
     settings().setValue("use_base32", base32);
-    QTableWidget* table = ui->resultsTableWidget;
-    for (int row = 0; row < table->rowCount(); row++) {
-        QTableWidgetItem* item = table->item(row, COLUMN_HASH);
-        HashItem* hash_item = dynamic_cast<HashItem*>(item);
-        if (hash_item) {
-            hash_item->updateHash();
-        }
-    }
+    results_->setBase32(base32);
 }
 
 void MainWindow::on_cp1251Action_triggered(bool cp1251) {
@@ -481,23 +370,158 @@ void MainWindow::on_selectDescriptionAction_triggered() {
     path = QFileDialog::getExistingDirectory(this,
             tr("Provide path to descriptions database"), path);
     settings().setValue("descriptions_root", path);
+    descriptions_.clear();
+    openDescriptionSource();
     qDebug() << path;
 }
 
+void MainWindow::on_buildIndexAction_triggered() {
+    QString path = inputPath();
+    if (!path.endsWith(".txt") && !path.endsWith(".gz")) {
+        QErrorMessage::qtHandler()->showMessage(tr("Select database file first"));
+        return;
+    }
+    IndexingThread* thread = new IndexingThread(path);
+    connect(thread, SIGNAL(finished(bool)),
+            this, SLOT(indexBuilt(bool)),
+            Qt::QueuedConnection);
+    ui->buildIndexAction->setEnabled(false);
+    statusBar()->showMessage(tr("Building search index..."));
+    QThreadPool::globalInstance()->start(thread);
+}
+
+void MainWindow::indexBuilt(bool ok) {
+    ui->buildIndexAction->setEnabled(true);
+    if (ok) {
+        statusBar()->showMessage(tr("Search index is ready"));
+    } else {
+        statusBar()->clearMessage();
+        QErrorMessage::qtHandler()->showMessage(tr("Error building search index!"));
+    }
+}
+
+void MainWindow::on_indexDescriptionsAction_triggered() {
+    if (!settings().contains("descriptions_root")) {
+        QErrorMessage::qtHandler()->showMessage(tr("Select descriptions database first"));
+        return;
+    }
+    // the id table is rewritten, nobody may map it meanwhile
+    descriptionIds_.clear();
+    stopDescriptionJobs();
+    QString root = settings().value("descriptions_root").toString();
+    DescriptionIndexingThread* thread = new DescriptionIndexingThread(root);
+    connect(thread, SIGNAL(progress(int, int)),
+            this, SLOT(descriptionsIndexProgress(int, int)),
+            Qt::QueuedConnection);
+    connect(thread, SIGNAL(finished(bool)),
+            this, SLOT(descriptionsIndexed(bool)),
+            Qt::QueuedConnection);
+    ui->indexDescriptionsAction->setEnabled(false);
+    statusBar()->showMessage(tr("Indexing descriptions..."));
+    QThreadPool::globalInstance()->start(thread);
+}
+
+void MainWindow::descriptionsIndexProgress(int done, int total) {
+    statusBar()->showMessage(tr("Indexing descriptions: %1 of %2 archives")
+                             .arg(done).arg(total));
+}
+
+void MainWindow::descriptionsIndexed(bool ok) {
+    ui->indexDescriptionsAction->setEnabled(true);
+    openDescriptionSource();
+    if (ok) {
+        statusBar()->showMessage(tr("Descriptions are indexed"));
+    } else {
+        statusBar()->clearMessage();
+        QErrorMessage::qtHandler()->showMessage(tr("Error indexing descriptions!"));
+    }
+}
+
+void MainWindow::on_packDescriptionsAction_triggered() {
+    if (!settings().contains("descriptions_root")) {
+        QErrorMessage::qtHandler()->showMessage(tr("Select descriptions database first"));
+        return;
+    }
+    // the store is rewritten, nobody may read it meanwhile
+    descriptionStore_.clear();
+    stopDescriptionJobs();
+    QString root = settings().value("descriptions_root").toString();
+    bool dictionary = settings().value("description_dictionary", true).toBool();
+    DescriptionPackingThread* thread = new DescriptionPackingThread(root, dictionary);
+    connect(thread, SIGNAL(progress(int, int)),
+            this, SLOT(descriptionsPackProgress(int, int)),
+            Qt::QueuedConnection);
+    connect(thread, SIGNAL(finished(bool)),
+            this, SLOT(descriptionsPacked(bool)),
+            Qt::QueuedConnection);
+    ui->packDescriptionsAction->setEnabled(false);
+    statusBar()->showMessage(tr("Packing descriptions..."));
+    QThreadPool::globalInstance()->start(thread);
+}
+
+void MainWindow::descriptionsPackProgress(int done, int total) {
+    statusBar()->showMessage(tr("Packing descriptions: %1 of %2 archives")
+                             .arg(done).arg(total));
+}
+
+void MainWindow::descriptionsPacked(bool ok) {
+    ui->packDescriptionsAction->setEnabled(true);
+    openDescriptionSource();
+    if (ok) {
+        statusBar()->showMessage(tr("Descriptions are packed"));
+    } else {
+        statusBar()->clearMessage();
+        QErrorMessage::qtHandler()->showMessage(tr("Error packing descriptions!"));
+    }
+}
+
 void MainWindow::openUrl(QString url) {
     ui->descriptionWebView->load(url);
     ui->descriptionWebView->show();
 }
 
 void MainWindow::on_patternLineEdit_returnPressed() {
-    if (!keepSearching()) {
+    typingTimer_->stop();
+    if (!refineSearch(ui->patternLineEdit->text())) {
         search();
-    } else {
-        stopFilling();
-        QTimer::singleShot(500, this, SLOT(search()));
     }
 }
 
+// Typing a longer pattern filters the rows found already; anything else
+// searches the dump once typing pauses. Either way the running search
+// stops at once, its rows are stale.
+void MainWindow::on_patternLineEdit_textEdited(const QString& text) {
+    cancelSearch();
+    if (!refineSearch(text) && !text.trimmed().isEmpty()) {
+        typingTimer_->start();
+    }
+}
+
+void MainWindow::on_findHashesAction_triggered() {
+    QString path = QFileDialog::getOpenFileName(this,
+            tr("Provide file with info-hashes or magnet links"), appDir().absolutePath());
+    if (path.isEmpty()) {
+        return;
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QErrorMessage::qtHandler()->showMessage(tr("Error opening file!"));
+        return;
+    }
+    batchHashes_.clear();
+    while (!file.atEnd()) {
+        QByteArray hash = HashIndex::parseHash(QString::fromUtf8(file.readLine()));
+        if (!hash.isEmpty()) {
+            batchHashes_ << hash;
+        }
+    }
+    if (batchHashes_.isEmpty()) {
+        QErrorMessage::qtHandler()->showMessage(tr("No info-hashes found in the file"));
+        return;
+    }
+    searchHashes();
+}
+
 QString backupName(QString path) {
     for (int i = 0;; i++) {
         QString name = path + "." + QString::number(i);
@@ -518,56 +542,69 @@ void MainWindow::on_unpackAction_triggered() {
         return;
     }
     qDebug() << "Unpack " << zip_path;
-    QFile inputFile(zip_path);
-    if (inputFile.open(QIODevice::ReadOnly)) {
-        QStringList zip_path_split = zip_path.split('.');
-        zip_path_split.pop_back(); // remove .gz etc
-        QString path = zip_path_split.join(".");
-        if (QFile(path).exists()) {
-            QFile(path).rename(backupName(path));
-        }
-        QFile outputFile(path);
-        inputFile.close();
-        if (gUncompress(&inputFile,&outputFile))
-            settings().setValue("final_txt", path);
-        else
-            QErrorMessage::qtHandler()->showMessage(tr("Error openning output database file!"));
-    } else
-        QErrorMessage::qtHandler()->showMessage(tr("Error openning input database file!"));
-}
-
-void MainWindow::addLines(QStringList_ptr lines) {
-    if (!keepSearching()) {
+    QStringList zip_path_split = zip_path.split('.');
+    zip_path_split.pop_back(); // remove .gz etc
+    QString path = zip_path_split.join(".");
+    if (QFile(path).exists()) {
+        QFile(path).rename(backupName(path));
+    }
+    UnpackingThread* thread = new UnpackingThread(zip_path, path);
+    connect(thread, SIGNAL(progress(int, double)),
+            this, SLOT(unpackProgress(int, double)),
+            Qt::QueuedConnection);
+    connect(thread, SIGNAL(finished(bool, QString)),
+            this, SLOT(unpacked(bool, QString)),
+            Qt::QueuedConnection);
+    ui->unpackAction->setEnabled(false);
+    statusBar()->showMessage(tr("Unpacking database..."));
+    QThreadPool::globalInstance()->start(thread);
+}
+
+void MainWindow::unpackProgress(int percent, double speed) {
+    statusBar()->showMessage(tr("Unpacking database: %1% (%2 MB/s)")
+                             .arg(percent).arg(speed, 0, 'f', 1));
+}
+
+void MainWindow::unpacked(bool ok, QString path) {
+    ui->unpackAction->setEnabled(true);
+    if (ok) {
+        settings().setValue("final_txt", path);
+        statusBar()->showMessage(tr("Database is unpacked"));
+    } else {
+        statusBar()->clearMessage();
+        QErrorMessage::qtHandler()->showMessage(tr("Error unpacking database!"));
+    }
+}
+
+// The rows of several chunks go into the table as one insertion. The
+// number of rows per frame doubles while that takes well under the frame
+// budget and halves when it takes longer.
+void MainWindow::drainResults() {
+    if (!searchRing_) {
         return;
     }
-    QTableWidget* table = ui->resultsTableWidget;
-    foreach (const QString& line, *lines) {
-        QStringList fields = line.split('\t');
-        if (fields.size() != 8) {
-            fields = line.split('|');
-        }
-        int id = fields[0].toInt();
-        QString name = fields[1];
-        qlonglong size = fields[2].toLongLong();
-        int seeds = fields[3].toInt();
-        int leeches = fields[4].toInt();
-        QString hash = fields[5];
-        qlonglong downloads = fields[6].toLongLong();
-        QDateTime updated = parseUpdated(fields[7]);
-        table->insertRow(table->rowCount());
-        int row = table->rowCount() - 1;
-        table->setItem(row, COLUMN_ID, new IDItem(id));
-        setData(row, COLUMN_NAME, name);
-        table->setItem(row, COLUMN_SIZE, new SizeItem(size));
-        setData(row, COLUMN_SEEDS, seeds);
-        setData(row, COLUMN_LEECHES, leeches);
-        table->setItem(row, COLUMN_HASH, new HashItem(hash, name, size));
-        setData(row, COLUMN_DOWNLOADS, downloads);
-        setData(row, COLUMN_UPDATED, updated);
+    QElapsedTimer timer;
+    timer.start();
+    int rows = takeResults(drainRows_);
+    qint64 elapsed = timer.elapsed();
+    if (elapsed > DRAIN_BUDGET_MS) {
+        drainRows_ = qMax(drainRows_ / 2, int(MIN_DRAIN_ROWS));
+    } else if (rows >= drainRows_ && elapsed < DRAIN_BUDGET_MS / 2) {
+        drainRows_ = qMin(drainRows_ * 2, int(MAX_DRAIN_ROWS));
     }
 }
 
-QIODevice* MainWindow::getInputDevice() {
+int MainWindow::takeResults(int max_rows) {
+    ResultStore results;
+    ResultStore_ptr chunk;
+    while (results.size() < max_rows && searchRing_->pop(&chunk)) {
+        results.append(*chunk);
+    }
+    results_->addResults(results);
+    return results.size();
+}
+
+QString MainWindow::inputPath() {
     QString input_path;
     if (input_path.isEmpty() && settings().contains("final_txt")) {
         QString path = settings().value("final_txt").toString();
@@ -591,6 +628,11 @@ QIODevice* MainWindow::getInputDevice() {
             }
         }
     }
+    return input_path;
+}
+
+QIODevice* MainWindow::getInputDevice() {
+    QString input_path = inputPath();
     //InputPtr input;
     if (!input_path.isEmpty() && QFile(input_path).exists()) {
         qDebug() << input_path;
@@ -612,22 +654,51 @@ void MainWindow::search() {
     int limit = ui->limitSpinBox->value();
     settings().setValue("pattern", pattern);
     settings().setValue("limit", limit);
+    startSearch(pattern, QSet<QByteArray>(), limit);
+}
+
+void MainWindow::searchHashes() {
+    startSearch(QString(), batchHashes_,
+                qMax(ui->limitSpinBox->value(), batchHashes_.size()));
+}
+
+void MainWindow::startSearch(QString pattern, QSet<QByteArray> hashes, int limit) {
+    cancelSearch();
     QIODevice* input = getInputDevice();
     if (input && input->open(QIODevice::ReadOnly)) {
-        startFilling();
         bool cp1251 = false;
         if (settings().contains("cp1251") && settings().value("cp1251").toBool()) {
             cp1251 = true;
         }
-        SearchingThread* thread = new SearchingThread(input, this, limit, pattern, cp1251);
-        connect(thread, SIGNAL(newLines(QStringList_ptr)),
-                this, SLOT(addLines(QStringList_ptr)),
-                Qt::QueuedConnection);
+        // each search stops on its own, so a new one starts right away;
+        // searchFinished deletes it with its input
+        SearchingThread* thread = new SearchingThread(input, limit, pattern, cp1251);
+        thread->setAutoDelete(false);
+        input->setParent(thread);
+        thread->setHashes(hashes);
+        // the limit best rows of the sort order rather than the first ones,
+        // the default order by downloads included
+        QHeaderView* header = ui->resultsTableView->horizontalHeader();
+        int sort_field = columnField(header->sortIndicatorSection());
+        if (sort_field >= 0) {
+            thread->setTopBy(sort_field, header->sortIndicatorOrder() == Qt::AscendingOrder);
+        }
+        // rows come through the ring, drained once a frame
+        searchRing_ = ResultRing_ptr(new ResultRing);
+        thread->setRing(searchRing_);
         connect(thread, SIGNAL(stopFilling()),
-                this, SLOT(stopFilling()),
+                this, SLOT(searchFinished()),
                 Qt::QueuedConnection);
+        search_ = thread;
+        startFilling();
+        // hash batches are not refined by typing
+        searchedPattern_ = hashes.isEmpty() ? pattern : QString();
+        searchedSource_ = searchSource();
+        searchLimit_ = limit;
+        searchedAll_ = false;
         QThreadPool::globalInstance()->start(thread);
     } else {
+        delete input;
         QErrorMessage::qtHandler()->showMessage(tr("Error openning database file!"));
     }
 }
@@ -642,120 +713,86 @@ void MainWindow::updateButtons() {
     }
 }
 
-QString MainWindow::descriptionById(int id) {
-    QDir dir0 = appDir();
+QString MainWindow::descriptionsRoot() {
     if (settings().contains("descriptions_root")) {
-        dir0 = settings().value("descriptions_root").toString();
-    }
-    QString id_c = QString("%1").arg(id, /*width*/ int(8), /*base*/ int(10), QChar('0'));
-    QString dir = id_c.left(3);
-    dir0.cd(dir);
-    QString tar = id_c.left(5) + ".tar.gz";
-    QString tar_abs = dir0.absoluteFilePath(tar);
-    if (!QFile(tar_abs).exists()) {
-        tar_abs += ".gz";
-        if (!QFile(tar_abs).exists()) {
-            qDebug() << "!QFile(tar_abs).exists()" << tar_abs;
-            return "";
-        }
-    }
-    qDebug() << tar_abs;
-    QFile tar_gz_file(tar_abs);
-    if(!tar_gz_file.open(QIODevice::ReadOnly)){
-        qDebug()<<"!tar_gz_file.open"; return "";
-    }
-    QByteArray tar_gz_ba=tar_gz_file.readAll(); // _ba means QByteArray, _file means QFile
-    tar_gz_file.close();
-    QByteArray tar_ba=gUncompress(tar_gz_ba);
-    QBuffer tar_buf; tar_buf.open(QIODevice::ReadWrite); tar_buf.write(tar_ba); tar_buf.close();
-    bugless::Archive tar_ar(&tar_buf,(bugless::Archive::Type)2);
-    if(!tar_ar.valid()){
-        qDebug()<<"tar archive turned invalid!"; return "";
+        return settings().value("descriptions_root").toString();
     }
-    QIODevice* desc_dev;
-    if((desc_dev=tar_ar.device(id_c))==NULL){
-        qDebug()<<"somehow failed to extract description file from tar archive"; return "";
-    }
-    desc_dev->open(QIODevice::ReadOnly);
-    QString description=QString::fromUtf8(desc_dev->readAll());
-    desc_dev->close();
-    return description;
+    return appDir().absolutePath();
 }
 
-IDItem* MainWindow::get_current_item()
-{
-    QTableWidget* table = ui->resultsTableWidget;
-    QModelIndex index = table->currentIndex();
-    int row = index.row();
-    int col = COLUMN_ID;
-    if (row >= 0)
-    {
-        return dynamic_cast<IDItem*>(table->item(row, col));
-    }
-    else
-        return NULL;
-//    return item;
+DescriptionSource MainWindow::descriptionSource() {
+    DescriptionSource source;
+    source.root = descriptionsRoot();
+    source.cache = &descriptions_;
+    source.store = descriptionStore_;
+    source.ids = descriptionIds_;
+    return source;
 }
 
-HashItem* MainWindow::get_current_hash_item()
-{
-    QTableWidget* table = ui->resultsTableWidget;
-    QModelIndex index = table->currentIndex();
-    int row = index.row();
-    qDebug() << row;
-    if (row >= 0)
-    {
-        int col = COLUMN_HASH;
-        return dynamic_cast<HashItem*>(table->item(row, col));
+void MainWindow::openDescriptionSource() {
+    DescriptionStore_ptr store(new DescriptionStore);
+    if (store->open(DescriptionStore::storePath(descriptionsRoot()))) {
+        descriptionStore_ = store;
+    } else {
+        descriptionStore_.clear();
     }
-    return NULL;
+    IdIndex_ptr ids(new IdIndex);
+    if (DescriptionIndexingThread::openIds(descriptionsRoot(), ids.data())) {
+        descriptionIds_ = ids;
+    } else {
+        descriptionIds_.clear();
+    }
+}
 
-//    return item;
+void MainWindow::stopDescriptionJobs() {
+    descriptionRequest_.fetchAndAddOrdered(1);
+    prefetchRequest_.fetchAndAddOrdered(1);
+    descriptionPool_.waitForDone();
 }
 
-void MainWindow::setData(int row, int col, const QVariant& data) {
-    QTableWidgetItem* item = new QTableWidgetItem;
-    item->setData(Qt::DisplayRole, data);
-    QTableWidget* table = ui->resultsTableWidget;
-    table->setItem(row, col, item);
+int MainWindow::currentRow() {
+    int row = ui->resultsTableView->currentIndex().row();
+    return row < results_->rowCount() ? row : -1;
 }
 
 void MainWindow::on_action_copy_rutracker_link_triggered()
 {
-    IDItem* item = get_current_item();
-    if (item)
+    int row = currentRow();
+    if (row >= 0)
     {
-        QString url = rutrackerUrl(item->id());
+        QString url = rutrackerUrl(results_->id(row));
         QApplication::clipboard()->setText(url);
     }
 }
 
 void MainWindow::on_action_open_rutracker_triggered()
 {
-    IDItem* item = get_current_item();
-    if (item)
+    int row = currentRow();
+    if (row >= 0)
     {
-        QString url = rutrackerUrl(item->id());
+        QString url = rutrackerUrl(results_->id(row));
         mainWindow()->openUrl(url);
     }
 }
 
 void MainWindow::on_action_copy_magnet_triggered()
 {
-    HashItem* item = get_current_hash_item();
-    if (item)
+    int row = currentRow();
+    if (row >= 0)
     {
-        QString url = magnetUrl(item->hash(), item->name_, item->size_, true);
+        QString url = magnetUrl(results_->hash(row), results_->name(row),
+                                results_->torrentSize(row), true);
         QApplication::clipboard()->setText(url);
     }
 }
 
 void MainWindow::on_action_open_magnet_triggered()
 {
-    HashItem* item = get_current_hash_item();
-    if (item)
+    int row = currentRow();
+    if (row >= 0)
     {
-        QString url = magnetUrl(item->hash(), item->name_, item->size_, false);
+        QString url = magnetUrl(results_->hash(row), results_->name(row),
+                                results_->torrentSize(row), false);
         QDesktopServices::openUrl(url);
     }
 }
@@ -3,22 +3,34 @@
 
 #include <QtCore>
 #include <QMainWindow>
+#include "searching_thread.h"
+#include "description_cache.h"
+#include "description_loader.h"
 namespace Ui {
 class MainWindow;
-class IDItem;
-class HashItem;
 }
 
 class MainWindow;
-class IDItem;
-class HashItem;
+class ResultsModel;
 typedef QSharedPointer<QIODevice> InputPtr;
-typedef QSharedPointer<QStringList> QStringList_ptr;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 public:
+    enum {
+        DEFAULT_PREFETCH_ROWS = 20,
+        // below fetches of the selected row
+        PREFETCH_PRIORITY = -1,
+        // typing pause before the dump is searched again
+        TYPING_DELAY_MS = 150,
+        // results of a running search go into the table once a frame
+        DRAIN_INTERVAL_MS = 16,
+        DRAIN_BUDGET_MS = 8,
+        MIN_DRAIN_ROWS = 64,
+        MAX_DRAIN_ROWS = 64 * 1024
+    };
+
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
@@ -27,7 +39,7 @@ public:
     }
 
     bool keepSearching() const {
-        return keepSearching_;
+        return search_ != 0;
     }
 
     bool useBase32() const {
@@ -38,22 +50,38 @@ public slots:
     void on_searchButton_clicked();
     void on_stopButton_clicked();
     void on_patternLineEdit_returnPressed();
+    void on_patternLineEdit_textEdited(const QString& text);
     void on_unpackAction_triggered();
     void on_exitAction_triggered();
     void on_selectAction_triggered();
     void on_base32Action_triggered(bool base32);
     void on_cp1251Action_triggered(bool cp1251);
     void on_selectDescriptionAction_triggered();
+    void on_buildIndexAction_triggered();
+    void on_indexDescriptionsAction_triggered();
+    void on_packDescriptionsAction_triggered();
+    void on_findHashesAction_triggered();
 
     void openUrl(QString url);
 
 private slots:
-    void addLines(QStringList_ptr lines);
+    void drainResults();
     void startFilling();
     void stopFilling();
+    void searchFinished();
     void showDescription(int id);
+    void descriptionLoaded(int id, QString description);
+    void prefetchDescriptions();
     void rowChanged(QModelIndex current);
     void search();
+    void searchHashes();
+    void indexBuilt(bool ok);
+    void descriptionsIndexProgress(int done, int total);
+    void descriptionsIndexed(bool ok);
+    void descriptionsPackProgress(int done, int total);
+    void descriptionsPacked(bool ok);
+    void unpackProgress(int percent, double speed);
+    void unpacked(bool ok, QString path);
 
     void on_action_copy_rutracker_link_triggered();
 
@@ -65,33 +93,51 @@ private slots:
 
 private:
     Ui::MainWindow *ui;
-    bool keepSearching_;
     QSettings settings_;
     bool useBase32_;
-
-    void setData(int row, int col, const QVariant& data);
+    ResultsModel* results_;
+    QSet<QByteArray> batchHashes_; // read from a file
+    DescriptionCache descriptions_;
+    DescriptionStore_ptr descriptionStore_; // null if there is no store
+    IdIndex_ptr descriptionIds_; // null if there is no id table
+    QThreadPool descriptionPool_;
+    QAtomicInt descriptionRequest_; // bumped by every selection
+    QAtomicInt prefetchRequest_; // bumped by every prefetch
+    QTimer* prefetchTimer_;
+    int prefetchRows_; // prefetched below the visible rows
+    SearchingThread* search_; // the search filling the table, 0 if none
+    ResultRing_ptr searchRing_; // its results
+    QTimer* drainTimer_;
+    int drainRows_; // taken from the ring per frame
+    QTimer* typingTimer_;
+    // the pattern of the rows in the table and where they were found
+    QString searchedPattern_;
+    QString searchedSource_;
+    int searchLimit_;
+    bool searchedAll_; // the search ended below the limit, no hit is missing
+
+    QString inputPath();
     QIODevice* getInputDevice();
     void updateButtons();
-    QString descriptionById(int id);
-    IDItem* get_current_item();
-    HashItem* get_current_hash_item();
-};
-
-class SearchingThread : public QObject, public QRunnable {
-    Q_OBJECT
-public:
-    SearchingThread(QIODevice* input, MainWindow* window,
-                    int limit, QString pattern, bool cp1251);
-    void run();
-signals:
-    void newLines(QStringList_ptr lines);
-    void stopFilling();
-private:
-    QIODevice* input_;
-    MainWindow* window_;
-    int limit_;
-    QString pattern_;
-    bool cp1251_;
+    // looks for the hashes instead of the pattern if there are any
+    void startSearch(QString pattern, QSet<QByteArray> hashes, int limit);
+    // stops the search filling the table; its late results are dropped
+    void cancelSearch();
+    // moves rows from the ring into the table, returns their number
+    int takeResults(int max_rows);
+    // narrows down the rows of the last complete search if the pattern
+    // refines its pattern; false if the dump must be searched
+    bool refineSearch(const QString& pattern);
+    // the dump and its encoding, as searches see them
+    QString searchSource();
+    QString descriptionsRoot();
+    DescriptionSource descriptionSource();
+    // opens the store and the id table of the descriptions root
+    void openDescriptionSource();
+    // cancels description fetches and waits for them
+    void stopDescriptionJobs();
+    // current row of the results view or -1
+    int currentRow();
 };
 
 #endif // MAINWINDOW_H
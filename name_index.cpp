@@ -0,0 +1,277 @@
+#include "name_index.h"
+#include "dump_line.h"
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'D', 'V', 'T', 'R', 'I', 'G', '0', '1'};
+
+struct IndexHeader {
+    char magic[8];
+    qint64 dump_size;
+    qint64 dump_mtime;
+    quint64 line_count;
+    quint64 key_count;
+    quint64 offsets_pos;
+    quint64 keys_pos;
+    quint64 postings_pos;
+};
+
+struct KeyEntry {
+    quint64 key;
+    quint64 pos; // relative to postings_pos
+    quint32 bytes;
+    quint32 count;
+};
+
+void appendVarint(QByteArray& out, quint32 value) {
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+quint32 readVarint(const uchar*& p) {
+    quint32 value = 0;
+    int shift = 0;
+    uchar b;
+    do {
+        b = *p++;
+        value |= quint32(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return value;
+}
+
+void decodePostings(const uchar* p, quint32 count, QVector<quint32>* lines) {
+    lines->resize(count);
+    quint32 line = 0;
+    for (quint32 i = 0; i < count; i++) {
+        line += readVarint(p);
+        (*lines)[i] = line;
+    }
+}
+
+// keeps in a only the lines which are present in b (both sorted)
+void intersect(QVector<quint32>& a, const QVector<quint32>& b) {
+    int out = 0;
+    int j = 0;
+    for (int i = 0; i < a.size() && j < b.size(); ) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (b[j] < a[i]) {
+            j++;
+        } else {
+            a[out++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    a.resize(out);
+}
+
+bool entryLessThan(const KeyEntry* a, const KeyEntry* b) {
+    return a->count < b->count;
+}
+
+} // end of anonymous namespace
+
+QList<quint64> nameTrigrams(const QString& text) {
+    QList<quint64> result;
+    if (text.size() < 3) {
+        return result;
+    }
+    QVector<ushort> folded(text.size());
+    for (int i = 0; i < text.size(); i++) {
+        folded[i] = text[i].toCaseFolded().unicode();
+    }
+    QSet<quint64> seen;
+    for (int i = 0; i + 3 <= folded.size(); i++) {
+        quint64 key = (quint64(folded[i]) << 32) |
+                      (quint64(folded[i + 1]) << 16) |
+                      quint64(folded[i + 2]);
+        if (!seen.contains(key)) {
+            seen.insert(key);
+            result << key;
+        }
+    }
+    return result;
+}
+
+NameIndexBuilder::NameIndexBuilder() {
+}
+
+void NameIndexBuilder::addLine(qint64 offset, const QString& name) {
+    quint32 line = offsets_.size();
+    offsets_.append(offset);
+    foreach (quint64 key, nameTrigrams(name)) {
+        Postings& postings = postings_[key];
+        appendVarint(postings.deltas, line - postings.last);
+        postings.last = line;
+        postings.count += 1;
+    }
+}
+
+void NameIndexBuilder::addRecord(qint64 offset, const char* line, int size) {
+    const char* name;
+    int name_size;
+    if (nameField(line, size, &name, &name_size)) {
+        addLine(offset, QString::fromUtf8(name, name_size));
+    }
+}
+
+bool NameIndexBuilder::save(const QString& index_path, const QFileInfo& dump) const {
+    QList<quint64> keys = postings_.keys();
+    qSort(keys);
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.dump_size = dump.size();
+    header.dump_mtime = dump.lastModified().toTime_t();
+    header.line_count = offsets_.size();
+    header.key_count = keys.size();
+    header.offsets_pos = sizeof(IndexHeader);
+    header.keys_pos = header.offsets_pos + header.line_count * sizeof(qint64);
+    header.postings_pos = header.keys_pos + header.key_count * sizeof(KeyEntry);
+
+    QString tmp_path = index_path + ".tmp";
+    QFile out(tmp_path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "can not write index" << tmp_path;
+        return false;
+    }
+    bool ok = out.write((const char*)&header, sizeof(header)) == sizeof(header);
+    ok = ok && out.write((const char*)offsets_.constData(),
+                         offsets_.size() * sizeof(qint64)) == qint64(offsets_.size() * sizeof(qint64));
+    quint64 pos = 0;
+    foreach (quint64 key, keys) {
+        const Postings postings = postings_.value(key);
+        KeyEntry entry;
+        entry.key = key;
+        entry.pos = pos;
+        entry.bytes = postings.deltas.size();
+        entry.count = postings.count;
+        ok = ok && out.write((const char*)&entry, sizeof(entry)) == sizeof(entry);
+        pos += entry.bytes;
+    }
+    foreach (quint64 key, keys) {
+        const QByteArray deltas = postings_.value(key).deltas;
+        ok = ok && out.write(deltas) == deltas.size();
+    }
+    out.close();
+    if (!ok) {
+        QFile::remove(tmp_path);
+        return false;
+    }
+    QFile::remove(index_path);
+    return QFile::rename(tmp_path, index_path);
+}
+
+NameIndex::NameIndex():
+    map_(0), line_count_(0), key_count_(0),
+    offsets_(0), keys_(0), postings_(0) {
+}
+
+NameIndex::~NameIndex() {
+    close();
+}
+
+QString NameIndex::indexPath(const QString& dump_path) {
+    return dump_path + ".trigrams";
+}
+
+bool NameIndex::open(const QString& dump_path) {
+    close();
+    QFileInfo dump(dump_path);
+    file_.setFileName(indexPath(dump_path));
+    if (!dump.exists() || !file_.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file_.size();
+    if (size < qint64(sizeof(IndexHeader))) {
+        file_.close();
+        return false;
+    }
+    map_ = file_.map(0, size);
+    if (!map_) {
+        file_.close();
+        return false;
+    }
+    const IndexHeader* header = reinterpret_cast<const IndexHeader*>(map_);
+    bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->dump_size == dump.size() &&
+                 header->dump_mtime == qint64(dump.lastModified().toTime_t()) &&
+                 header->postings_pos <= quint64(size) &&
+                 header->keys_pos + header->key_count * sizeof(KeyEntry) == header->postings_pos &&
+                 header->offsets_pos + header->line_count * sizeof(qint64) == header->keys_pos;
+    if (!valid) {
+        qDebug() << "stale or broken index" << file_.fileName();
+        close();
+        return false;
+    }
+    line_count_ = header->line_count;
+    key_count_ = header->key_count;
+    offsets_ = reinterpret_cast<const qint64*>(map_ + header->offsets_pos);
+    keys_ = map_ + header->keys_pos;
+    postings_ = map_ + header->postings_pos;
+    return true;
+}
+
+void NameIndex::close() {
+    if (map_) {
+        file_.unmap(map_);
+        map_ = 0;
+    }
+    if (file_.isOpen()) {
+        file_.close();
+    }
+    line_count_ = key_count_ = 0;
+    offsets_ = 0;
+    keys_ = postings_ = 0;
+}
+
+bool NameIndex::candidates(const QString& pattern, QVector<qint64>* offsets) const {
+    offsets->clear();
+    if (!isOpen()) {
+        return false;
+    }
+    QList<quint64> trigrams = nameTrigrams(pattern);
+    if (trigrams.isEmpty()) {
+        return false;
+    }
+    const KeyEntry* begin = reinterpret_cast<const KeyEntry*>(keys_);
+    const KeyEntry* end = begin + key_count_;
+    QList<const KeyEntry*> entries;
+    foreach (quint64 key, trigrams) {
+        const KeyEntry* lo = begin;
+        const KeyEntry* hi = end;
+        while (lo < hi) {
+            const KeyEntry* mid = lo + (hi - lo) / 2;
+            if (mid->key < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == end || lo->key != key) {
+            return true; // some trigram never occurs: nothing matches
+        }
+        entries << lo;
+    }
+    // start from the rarest trigram to keep intersections short
+    qSort(entries.begin(), entries.end(), entryLessThan);
+    QVector<quint32> lines;
+    QVector<quint32> other;
+    decodePostings(postings_ + entries[0]->pos, entries[0]->count, &lines);
+    for (int i = 1; i < entries.size() && !lines.isEmpty(); i++) {
+        decodePostings(postings_ + entries[i]->pos, entries[i]->count, &other);
+        intersect(lines, other);
+    }
+    offsets->reserve(lines.size());
+    foreach (quint32 line, lines) {
+        if (line < line_count_) {
+            offsets->append(offsets_[line]);
+        }
+    }
+    return true;
+}
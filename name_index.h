@@ -0,0 +1,71 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <QtCore>
+
+// Trigram index over the name field of final.txt.
+//
+// The index lives next to the dump (final.txt.trigrams) and is built once
+// per dump. It stores the offset of every record line and, for every
+// trigram of the case folded name, the sorted list of lines containing it.
+// A query intersects the posting lists of the pattern trigrams; candidates
+// still have to be verified against the real line.
+
+class NameIndexBuilder {
+public:
+    NameIndexBuilder();
+
+    // lines must be added in file order
+    void addLine(qint64 offset, const QString& name);
+    // raw UTF-8 dump line, skipped if it is not a record
+    void addRecord(qint64 offset, const char* line, int size);
+
+    bool save(const QString& index_path, const QFileInfo& dump) const;
+
+private:
+    struct Postings {
+        Postings(): last(0), count(0) {
+        }
+        QByteArray deltas; // varint encoded gaps between line numbers
+        quint32 last;
+        quint32 count;
+    };
+
+    QVector<qint64> offsets_;
+    QHash<quint64, Postings> postings_;
+};
+
+class NameIndex {
+public:
+    NameIndex();
+    ~NameIndex();
+
+    // maps the index of dump_path; fails if it is missing or stale
+    bool open(const QString& dump_path);
+    void close();
+    bool isOpen() const {
+        return map_ != 0;
+    }
+
+    // Fills offsets with lines which may contain pattern, in file order.
+    // Returns false if the index can not answer (pattern is too short).
+    bool candidates(const QString& pattern, QVector<qint64>* offsets) const;
+
+    static QString indexPath(const QString& dump_path);
+
+private:
+    Q_DISABLE_COPY(NameIndex)
+
+    QFile file_;
+    uchar* map_;
+    quint64 line_count_;
+    quint64 key_count_;
+    const qint64* offsets_;
+    const uchar* keys_;
+    const uchar* postings_;
+};
+
+// case folded trigrams of text, without duplicates
+QList<quint64> nameTrigrams(const QString& text);
+
+#endif // NAME_INDEX_H
@@ -0,0 +1,295 @@
+#include "name_matcher.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NAME_MATCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(NAME_MATCHER_SSE2) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define NAME_MATCHER_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Windows-1251 byte -> byte of its lower case letter
+const uchar CP1251_FOLD[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
+    0x90, 0x83, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x9A, 0x8B, 0x9C, 0x9D, 0x9E, 0x9F,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+    0xA0, 0xA2, 0xA2, 0xBC, 0xA4, 0xB4, 0xA6, 0xA7, 0xB8, 0xA9, 0xBA, 0xAB, 0xAC, 0xAD, 0xAE, 0xBF,
+    0xB0, 0xB1, 0xB3, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBE, 0xBE, 0xBF,
+    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
+    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
+};
+
+// Folds one character of UTF-8 text to lower case.
+// Returns the number of bytes consumed, the same number is written to out.
+inline int foldUtf8(const uchar* p, const uchar* end, uchar* out) {
+    uchar c = p[0];
+    if (c >= 'A' && c <= 'Z') {
+        out[0] = c + ('a' - 'A');
+        return 1;
+    }
+    if (c == 0xD0 && p + 1 < end) {
+        uchar t = p[1];
+        if (t >= 0x80 && t <= 0x8F) {
+            // U+0400..U+040F -> U+0450..U+045F
+            out[0] = 0xD1;
+            out[1] = t + 0x10;
+        } else if (t >= 0x90 && t <= 0x9F) {
+            // U+0410..U+041F -> U+0430..U+043F
+            out[0] = 0xD0;
+            out[1] = t + 0x20;
+        } else if (t >= 0xA0 && t <= 0xAF) {
+            // U+0420..U+042F -> U+0440..U+044F
+            out[0] = 0xD1;
+            out[1] = t - 0x20;
+        } else {
+            out[0] = c;
+            out[1] = t;
+        }
+        return 2;
+    }
+    out[0] = c;
+    return 1;
+}
+
+// trail byte of the upper case form of a folded two byte Cyrillic letter
+uchar upperTrail(uchar lead, uchar trail) {
+    if (lead == 0xD0 && trail >= 0xB0 && trail <= 0xBF) {
+        return trail - 0x20;
+    }
+    if (lead == 0xD1 && trail >= 0x80 && trail <= 0x8F) {
+        return trail + 0x20;
+    }
+    if (lead == 0xD1 && trail >= 0x90 && trail <= 0x9F) {
+        return trail - 0x10;
+    }
+    return trail;
+}
+
+struct Needle {
+    const uchar* bytes;
+    int size;
+    int anchor;
+    uchar lower;
+    uchar upper;
+    bool cp1251;
+};
+
+// compares folded text at s with the folded pattern
+inline bool equalsAt(const Needle& n, const uchar* s, const uchar* end) {
+    if (end - s < n.size) {
+        return false;
+    }
+    if (n.cp1251) {
+        for (int i = 0; i < n.size; i++) {
+            if (CP1251_FOLD[s[i]] != n.bytes[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    int i = 0;
+    while (i < n.size) {
+        uchar f[2];
+        int len = foldUtf8(s, end, f);
+        if (f[0] != n.bytes[i] || (len == 2 && (i + 1 >= n.size || f[1] != n.bytes[i + 1]))) {
+            return false;
+        }
+        i += len;
+        s += len;
+    }
+    return true;
+}
+
+inline int countTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// q runs over positions of the anchor byte, last is the last one possible
+const uchar* searchScalar(const Needle& n, const uchar* q, const uchar* last,
+                          const uchar* end) {
+    for (; q <= last; q++) {
+        if ((*q == n.lower || *q == n.upper) && equalsAt(n, q - n.anchor, end)) {
+            return q - n.anchor;
+        }
+    }
+    return 0;
+}
+
+#ifdef NAME_MATCHER_SSE2
+const uchar* searchSse2(const Needle& n, const uchar* q, const uchar* last,
+                        const uchar* end) {
+    const __m128i lower = _mm_set1_epi8(char(n.lower));
+    const __m128i upper = _mm_set1_epi8(char(n.upper));
+    for (; q + 16 <= end && q <= last; q += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)q);
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, lower),
+                                                       _mm_cmpeq_epi8(x, upper)));
+        while (mask) {
+            const uchar* c = q + countTrailingZeros(mask);
+            if (c > last) {
+                return 0;
+            }
+            if (equalsAt(n, c - n.anchor, end)) {
+                return c - n.anchor;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return searchScalar(n, q, last, end);
+}
+#endif
+
+#ifdef NAME_MATCHER_AVX2
+__attribute__((target("avx2")))
+const uchar* searchAvx2(const Needle& n, const uchar* q, const uchar* last,
+                        const uchar* end) {
+    const __m256i lower = _mm256_set1_epi8(char(n.lower));
+    const __m256i upper = _mm256_set1_epi8(char(n.upper));
+    for (; q + 32 <= end && q <= last; q += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)q);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, lower),
+                                                             _mm256_cmpeq_epi8(x, upper)));
+        while (mask) {
+            const uchar* c = q + countTrailingZeros(mask);
+            if (c > last) {
+                return 0;
+            }
+            if (equalsAt(n, c - n.anchor, end)) {
+                return c - n.anchor;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return searchSse2(n, q, last, end);
+}
+
+bool hasAvx2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+#endif
+
+} // end of anonymous namespace
+
+NameMatcher::NameMatcher(const QString& pattern, bool cp1251):
+    pattern_(pattern),
+    codec_(QTextCodec::codecForName(cp1251 ? "Windows-1251" : "UTF-8")),
+    cp1251_(cp1251), bytewise_(true),
+    anchor_(0), anchor_lower_(0), anchor_upper_(0) {
+    if (cp1251) {
+        bytewise_ = codec_ && codec_->canEncode(pattern);
+        if (bytewise_) {
+            QByteArray encoded = codec_->fromUnicode(pattern);
+            for (int i = 0; i < encoded.size(); i++) {
+                folded_.append(char(CP1251_FOLD[uchar(encoded[i])]));
+            }
+        }
+    } else {
+        for (int i = 0; i < pattern.size(); i++) {
+            ushort u = pattern[i].unicode();
+            if (u >= 0x80 && (u < 0x400 || u > 0x45F)) {
+                bytewise_ = false;
+            }
+        }
+        if (bytewise_) {
+            QByteArray utf8 = pattern.toUtf8();
+            const uchar* p = (const uchar*)utf8.constData();
+            const uchar* end = p + utf8.size();
+            while (p < end) {
+                uchar f[2];
+                int n = foldUtf8(p, end, f);
+                folded_.append((const char*)f, n);
+                p += n;
+            }
+        }
+    }
+    if (!bytewise_ || folded_.isEmpty()) {
+        return;
+    }
+    uchar first = uchar(folded_[0]);
+    if (cp1251) {
+        anchor_lower_ = anchor_upper_ = first;
+        for (int b = 0; b < 256; b++) {
+            if (CP1251_FOLD[b] == first && b != first) {
+                anchor_upper_ = uchar(b);
+            }
+        }
+    } else if (first >= 0x80 && folded_.size() >= 2) {
+        // lead bytes of Cyrillic letters are shared by many letters,
+        // the trail byte is far more selective
+        anchor_ = 1;
+        anchor_lower_ = uchar(folded_[1]);
+        anchor_upper_ = upperTrail(first, anchor_lower_);
+    } else {
+        anchor_lower_ = first;
+        anchor_upper_ = (first >= 'a' && first <= 'z') ? first - ('a' - 'A') : first;
+    }
+}
+
+const char* NameMatcher::find(const char* text, int size) const {
+    if (!bytewise_) {
+        QString decoded = codec_ ? codec_->toUnicode(text, size) : QString::fromUtf8(text, size);
+        return decoded.contains(pattern_, Qt::CaseInsensitive) ? text : 0;
+    }
+    if (folded_.isEmpty()) {
+        return text;
+    }
+    if (size < folded_.size()) {
+        return 0;
+    }
+    Needle n;
+    n.bytes = (const uchar*)folded_.constData();
+    n.size = folded_.size();
+    n.anchor = anchor_;
+    n.lower = anchor_lower_;
+    n.upper = anchor_upper_;
+    n.cp1251 = cp1251_;
+    const uchar* begin = (const uchar*)text;
+    const uchar* end = begin + size;
+    const uchar* q = begin + n.anchor;
+    const uchar* last = end - n.size + n.anchor;
+#if defined(NAME_MATCHER_AVX2)
+    if (hasAvx2()) {
+        return (const char*)searchAvx2(n, q, last, end);
+    }
+    return (const char*)searchSse2(n, q, last, end);
+#elif defined(NAME_MATCHER_SSE2)
+    return (const char*)searchSse2(n, q, last, end);
+#else
+    return (const char*)searchScalar(n, q, last, end);
+#endif
+}
+
+const char* NameMatcher::kernelName() {
+#if defined(NAME_MATCHER_AVX2)
+    return hasAvx2() ? "avx2" : "sse2";
+#elif defined(NAME_MATCHER_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
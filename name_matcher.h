@@ -0,0 +1,43 @@
+#ifndef NAME_MATCHER_H
+#define NAME_MATCHER_H
+
+#include <QtCore>
+
+// Case insensitive substring search on raw UTF-8 or Windows-1251 names.
+//
+// Latin and Cyrillic letters are folded byte by byte, so names are never
+// decoded. Candidates are found by scanning for both cases of one pattern
+// byte with SSE2/AVX2 where available and verified by a scalar compare.
+// Patterns with other letters fall back to decoding the name and
+// QString::contains.
+
+class NameMatcher {
+public:
+    NameMatcher(const QString& pattern, bool cp1251 = false);
+
+    bool matches(const char* name, int size) const {
+        return find(name, size) != 0;
+    }
+
+    // first position of the pattern in text or 0; only for bytewise patterns
+    const char* find(const char* text, int size) const;
+
+    bool isBytewise() const {
+        return bytewise_;
+    }
+
+    // name of the vector kernel in use, for benchmarks
+    static const char* kernelName();
+
+private:
+    QString pattern_;
+    QTextCodec* codec_;
+    bool cp1251_;
+    bool bytewise_;
+    QByteArray folded_; // pattern in the dump encoding, folded to lower case
+    int anchor_;        // offset of the byte candidates are searched by
+    uchar anchor_lower_;
+    uchar anchor_upper_;
+};
+
+#endif // NAME_MATCHER_H
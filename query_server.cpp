@@ -0,0 +1,256 @@
+#include "query_server.h"
+#include "console_search.h"
+#include "dump_snapshot.h"
+#include "description_archive.h"
+#include "description_store.h"
+#include "hash_index.h"
+
+namespace {
+
+const int DEFAULT_LIMIT = 100;
+const int MAX_REQUEST_SIZE = 8 * 1024;
+
+QString optionValue(const QStringList& args, const QString& name) {
+    int i = args.indexOf(name);
+    return i >= 0 && i + 1 < args.size() ? args[i + 1] : QString();
+}
+
+QByteArray httpResponse(int status, const QByteArray& body) {
+    QByteArray reason = status == 200 ? "OK" :
+                        status == 400 ? "Bad Request" :
+                        status == 404 ? "Not Found" : "Method Not Allowed";
+    return "HTTP/1.0 " + QByteArray::number(status) + " " + reason + "\r\n"
+           "Content-Type: application/json; charset=utf-8\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+QByteArray errorResponse(int status, const QByteArray& message) {
+    return httpResponse(status, "{\"error\":" +
+                        jsonString(message.constData(), message.size()) + "}\n");
+}
+
+} // end of anonymous namespace
+
+void ResultCollector::addResults(ResultStore_ptr results) {
+    QMutexLocker locker(&mutex_);
+    results_.append(*results);
+}
+
+QueryJob::QueryJob(const QueryContext& context, const QByteArray& target):
+    context_(context), target_(target) {
+}
+
+QByteArray QueryJob::search(const QString& pattern, const QSet<QByteArray>& hashes,
+                            const QSet<int>& ids, int limit, int sort_field) {
+    QScopedPointer<QIODevice> input(newDumpDevice(context_.dump_path));
+    if (!input->open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    ResultCollector collector;
+    SearchingThread thread(input.data(), limit, pattern, context_.cp1251);
+    thread.setAutoDelete(false);
+    thread.setSnapshot(context_.snapshot);
+    thread.setHashes(hashes);
+    thread.setTopicIds(ids);
+    if (sort_field >= 0) {
+        thread.setTopBy(sort_field);
+    }
+    QObject::connect(&thread, SIGNAL(newResults(ResultStore_ptr)),
+                     &collector, SLOT(addResults(ResultStore_ptr)),
+                     Qt::DirectConnection);
+    thread.run();
+    // like a dump which does not open, rather than a partial answer
+    if (thread.broken()) {
+        return QByteArray();
+    }
+    const ResultStore& results = collector.results();
+    QByteArray body = "{\"results\":[";
+    for (int row = 0; row < results.size(); row++) {
+        if (row > 0) {
+            body += ',';
+        }
+        body += jsonRecord(results, row);
+    }
+    body += "]}\n";
+    return body;
+}
+
+void QueryJob::run() {
+    // '+' stands for a space in form encoded queries
+    QByteArray target = target_;
+    QUrl url = QUrl::fromEncoded(target.replace('+', "%20"));
+    QString path = url.path();
+    bool ok = true;
+    QByteArray body;
+    if (path == "/search") {
+        QString pattern = url.queryItemValue("q");
+        int limit = url.hasQueryItem("limit") ?
+                    url.queryItemValue("limit").toInt(&ok) : DEFAULT_LIMIT;
+        int sort_field = url.hasQueryItem("sort") ?
+                         SearchQuery::numberField(url.queryItemValue("sort")) : -1;
+        if (pattern.isEmpty() || !ok || limit <= 0) {
+            emit answered(errorResponse(400, "expected q and a positive limit"));
+            return;
+        }
+        if (url.hasQueryItem("sort") && sort_field < 0) {
+            emit answered(errorResponse(400, "unknown sort field"));
+            return;
+        }
+        // pasted hashes and links reach the key indexes through the query
+        body = search(pattern, QSet<QByteArray>(), QSet<int>(), limit, sort_field);
+    } else if (path == "/id") {
+        int id = url.queryItemValue("id").toInt(&ok);
+        if (!ok || id < 0) {
+            emit answered(errorResponse(400, "expected id"));
+            return;
+        }
+        body = search(QString(), QSet<QByteArray>(), QSet<int>() << id, DEFAULT_LIMIT);
+    } else if (path == "/hash") {
+        QByteArray hash = HashIndex::parseHash(url.queryItemValue("hash"));
+        if (hash.isEmpty()) {
+            emit answered(errorResponse(400, "expected hash"));
+            return;
+        }
+        body = search(QString(), QSet<QByteArray>() << hash, QSet<int>(), DEFAULT_LIMIT);
+    } else if (path == "/description") {
+        int id = url.queryItemValue("id").toInt(&ok);
+        if (!ok || id < 0) {
+            emit answered(errorResponse(400, "expected id"));
+            return;
+        }
+        QByteArray description = loadDescription(context_.descriptions, id).toUtf8();
+        if (!description.isEmpty()) {
+            body = "{\"id\":" + QByteArray::number(id) + ",\"description\":" +
+                   jsonString(description.constData(), description.size()) + "}\n";
+        }
+    } else {
+        emit answered(errorResponse(404, "unknown query"));
+        return;
+    }
+    emit answered(body.isEmpty() ? errorResponse(404, "not found") : httpResponse(200, body));
+}
+
+QueryConnection::QueryConnection(QTcpSocket* socket, const QueryContext& context,
+                                 QThreadPool* workers):
+    QObject(socket), socket_(socket), idleTimer_(new QTimer(this)), context_(context),
+    workers_(workers), started_(false) {
+    connect(socket_, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(socket_, SIGNAL(disconnected()), socket_, SLOT(deleteLater()));
+    idleTimer_->setSingleShot(true);
+    idleTimer_->setInterval(IDLE_TIMEOUT_MS);
+    connect(idleTimer_, SIGNAL(timeout()), this, SLOT(idle()));
+    idleTimer_->start();
+}
+
+void QueryConnection::readRequest() {
+    if (started_) {
+        return;
+    }
+    idleTimer_->start();
+    request_ += socket_->readAll();
+    if (request_.size() > MAX_REQUEST_SIZE) {
+        send(errorResponse(400, "request is too long"));
+        return;
+    }
+    if (!request_.contains("\r\n\r\n") && !request_.contains("\n\n")) {
+        return;
+    }
+    started_ = true;
+    idleTimer_->stop();
+    // "GET /search?q=... HTTP/1.1"
+    QList<QByteArray> words = request_.left(request_.indexOf('\n')).trimmed().split(' ');
+    if (words.size() < 2 || words[0] != "GET") {
+        send(errorResponse(405, "only GET is served"));
+        return;
+    }
+    QueryJob* job = new QueryJob(context_, words[1]);
+    connect(job, SIGNAL(answered(QByteArray)),
+            this, SLOT(send(QByteArray)),
+            Qt::QueuedConnection);
+    workers_->start(job);
+}
+
+void QueryConnection::send(QByteArray response) {
+    started_ = true;
+    idleTimer_->stop();
+    socket_->write(response);
+    socket_->disconnectFromHost();
+}
+
+// a client holding a connection without asking keeps a socket for nothing
+void QueryConnection::idle() {
+    if (!started_) {
+        socket_->abort();
+        socket_->deleteLater();
+    }
+}
+
+QueryServer::QueryServer(const QueryContext& context):
+    context_(context) {
+    connect(&server_, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+bool QueryServer::listen(quint16 port) {
+    // other users of the machine only, nothing is exposed outside
+    return server_.listen(QHostAddress::LocalHost, port);
+}
+
+void QueryServer::acceptConnection() {
+    while (server_.hasPendingConnections()) {
+        new QueryConnection(server_.nextPendingConnection(), context_, &workers_);
+    }
+}
+
+bool isQueryServer(const QStringList& args) {
+    return args.contains("--serve");
+}
+
+int runQueryServer(const QStringList& args) {
+    QString port_text = optionValue(args, "--port");
+    bool ok = true;
+    int port = port_text.isEmpty() ? int(QueryServer::DEFAULT_PORT) : port_text.toInt(&ok);
+    if (!ok || port <= 0 || port > 65535) {
+        fprintf(stderr, "usage: dump_viewer --serve [--port N] [--dump PATH]\n");
+        return 2;
+    }
+    QSettings settings(viewerSettingsPath(), QSettings::IniFormat);
+    QueryContext context;
+    context.dump_path = optionValue(args, "--dump");
+    if (context.dump_path.isEmpty()) {
+        context.dump_path = defaultDumpPath(settings);
+    }
+    if (context.dump_path.isEmpty() || !QFile(context.dump_path).exists()) {
+        fprintf(stderr, "can not open database file %s\n", qPrintable(context.dump_path));
+        return 1;
+    }
+    context.cp1251 = settings.value("cp1251").toBool();
+    context.snapshot = DumpSnapshot_ptr(new DumpSnapshot);
+    if (!context.snapshot->open(context.dump_path)) {
+        qDebug() << "no snapshot, searches scan the dump";
+        context.snapshot.clear();
+    }
+    QString root = settings.value("descriptions_root",
+                                  QFileInfo(viewerSettingsPath()).absolutePath()).toString();
+    DescriptionCache cache(settings.value("description_cache_mb",
+                                          int(DescriptionCache::DEFAULT_BUDGET_MB)).toInt());
+    context.descriptions.root = root;
+    context.descriptions.cache = &cache;
+    context.descriptions.store = DescriptionStore_ptr(new DescriptionStore);
+    if (!context.descriptions.store->open(DescriptionStore::storePath(root))) {
+        context.descriptions.store.clear();
+    }
+    context.descriptions.ids = IdIndex_ptr(new IdIndex);
+    if (!DescriptionIndexingThread::openIds(root, context.descriptions.ids.data())) {
+        context.descriptions.ids.clear();
+    }
+    QueryServer server(context);
+    if (!server.listen(port)) {
+        fprintf(stderr, "can not listen on port %d\n", port);
+        return 1;
+    }
+    fprintf(stderr, "serving %s on http://127.0.0.1:%d/\n",
+            qPrintable(context.dump_path), port);
+    return QCoreApplication::exec();
+}
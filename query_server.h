@@ -0,0 +1,116 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <QtCore>
+#include <QtNetwork>
+#include "searching_thread.h"
+#include "description_cache.h"
+#include "description_loader.h"
+
+// Long-lived query service for several users of one machine:
+//
+//   dump_viewer --serve [--port N] [--dump PATH]
+//
+// The snapshot of the dump and the description indexes are opened once
+// and shared by all queries. Answers are JSON over HTTP on loopback:
+//
+//   GET /search?q=TEXT&limit=N   records matching like the search box,
+//               [&sort=FIELD]    pasted hashes and links included;
+//                                the N largest by a numeric field
+//   GET /id?id=N                 the record of a topic
+//   GET /hash?hash=H             records of an info-hash or magnet link
+//   GET /description?id=N        the description of a topic
+//
+// Requests are read on the main thread and answered by a worker pool, so
+// slow scans do not hold up other queries. Connections which send no
+// complete request within a few seconds are closed.
+
+// true if the arguments ask for the query service
+bool isQueryServer(const QStringList& args);
+
+// serves until the process is killed, returns the exit code
+int runQueryServer(const QStringList& args);
+
+// What the queries read, shared by the jobs.
+struct QueryContext {
+    QString dump_path;
+    bool cp1251;
+    DumpSnapshot_ptr snapshot; // null if the dump has no snapshot
+    DescriptionSource descriptions;
+};
+
+// Collects the chunks of one search; the scanners add from their own
+// threads through direct connections.
+class ResultCollector : public QObject {
+    Q_OBJECT
+public:
+    const ResultStore& results() const {
+        return results_;
+    }
+public slots:
+    void addResults(ResultStore_ptr results);
+private:
+    QMutex mutex_;
+    ResultStore results_;
+};
+
+// Answers one request in a pool thread.
+class QueryJob : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    QueryJob(const QueryContext& context, const QByteArray& target);
+    void run();
+signals:
+    void answered(QByteArray response);
+private:
+    QueryContext context_;
+    QByteArray target_; // path and query of the request line
+
+    // JSON body of the answer, empty if nothing is found
+    // sort_field, if not -1, asks for the limit largest by it
+    QByteArray search(const QString& pattern, const QSet<QByteArray>& hashes,
+                      const QSet<int>& ids, int limit, int sort_field = -1);
+};
+
+// One client connection, lives on the main thread.
+class QueryConnection : public QObject {
+    Q_OBJECT
+public:
+    enum {
+        IDLE_TIMEOUT_MS = 5000
+    };
+
+    QueryConnection(QTcpSocket* socket, const QueryContext& context,
+                    QThreadPool* workers);
+private slots:
+    void readRequest();
+    void send(QByteArray response);
+    void idle();
+private:
+    QTcpSocket* socket_;
+    QTimer* idleTimer_; // restarted by every read until the request is in
+    const QueryContext& context_;
+    QThreadPool* workers_;
+    QByteArray request_;
+    bool started_;
+};
+
+class QueryServer : public QObject {
+    Q_OBJECT
+public:
+    enum {
+        DEFAULT_PORT = 8421
+    };
+
+    QueryServer(const QueryContext& context);
+
+    bool listen(quint16 port);
+private slots:
+    void acceptConnection();
+private:
+    QueryContext context_;
+    QTcpServer server_;
+    QThreadPool workers_;
+};
+
+#endif // QUERY_SERVER_H
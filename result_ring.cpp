@@ -0,0 +1,30 @@
+#include "result_ring.h"
+
+ResultRing::ResultRing():
+    head_(0), tail_(0) {
+}
+
+// Qt 4 atomics have no plain acquire load, fetchAndAddAcquire(0) is one.
+
+bool ResultRing::push(ResultStore_ptr results) {
+    int tail = tail_;
+    int next = (tail + 1) % CAPACITY;
+    if (next == head_.fetchAndAddAcquire(0)) {
+        return false;
+    }
+    chunks_[tail] = results;
+    tail_.fetchAndStoreRelease(next);
+    return true;
+}
+
+bool ResultRing::pop(ResultStore_ptr* results) {
+    int head = head_;
+    if (head == tail_.fetchAndAddAcquire(0)) {
+        return false;
+    }
+    *results = chunks_[head];
+    // the slot must not keep the chunk alive until it is reused
+    chunks_[head].clear();
+    head_.fetchAndStoreRelease((head + 1) % CAPACITY);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef RESULT_RING_H
+#define RESULT_RING_H
+
+#include <QtCore>
+#include "result_store.h"
+
+// Hand-off of search results from a search to the window without queued
+// signals.
+//
+// A fixed ring of ResultStore chunks with one producer and one consumer: the
+// search pushes from one scanner at a time, the window pops on a frame
+// timer. Neither side locks; the producer publishes a
+// slot by moving the tail with release order and the consumer frees it by
+// moving the head, so each slot is touched by one side at a time.
+
+class ResultRing {
+public:
+    enum {
+        CAPACITY = 1024
+    };
+
+    ResultRing();
+
+    // producer side; false if the ring is full
+    bool push(ResultStore_ptr results);
+
+    // consumer side; false if the ring is empty
+    bool pop(ResultStore_ptr* results);
+
+private:
+    Q_DISABLE_COPY(ResultRing)
+
+    ResultStore_ptr chunks_[CAPACITY];
+    QAtomicInt head_; // next slot to pop, moved by the consumer
+    QAtomicInt tail_; // next slot to push, moved by the producer
+};
+
+typedef QSharedPointer<ResultRing> ResultRing_ptr;
+
+#endif // RESULT_RING_H
@@ -0,0 +1,80 @@
+#include "result_store.h"
+#include "dump_line.h"
+#include "torrent_hash_convert.h"
+
+void ResultStore::clear() {
+    ids_.clear();
+    sizes_.clear();
+    seeds_.clear();
+    leeches_.clear();
+    downloads_.clear();
+    updated_.clear();
+    hashes_.clear();
+    names_.clear();
+    name_begin_.clear();
+    name_end_.clear();
+}
+
+void ResultStore::append(int id, const QByteArray& name, qlonglong size,
+                         int seeds, int leeches, const QByteArray& hash,
+                         qlonglong downloads, uint updated) {
+    ids_.append(id);
+    name_begin_.append(names_.size());
+    names_.append(name);
+    name_end_.append(names_.size());
+    sizes_.append(size);
+    seeds_.append(seeds);
+    leeches_.append(leeches);
+    QByteArray hash_bytes = hash.left(HASH_SIZE);
+    hash_bytes.append(QByteArray(HASH_SIZE - hash_bytes.size(), '\0'));
+    hashes_.append(hash_bytes);
+    downloads_.append(downloads);
+    updated_.append(updated);
+}
+
+void ResultStore::append(const ResultStore& other) {
+    int name_shift = names_.size();
+    ids_ += other.ids_;
+    sizes_ += other.sizes_;
+    seeds_ += other.seeds_;
+    leeches_ += other.leeches_;
+    downloads_ += other.downloads_;
+    updated_ += other.updated_;
+    hashes_ += other.hashes_;
+    names_ += other.names_;
+    for (int i = 0; i < other.size(); i++) {
+        name_begin_.append(other.name_begin_[i] + name_shift);
+        name_end_.append(other.name_end_[i] + name_shift);
+    }
+}
+
+void ResultStore::append(const ResultRecord& record) {
+    ids_.append(record.id);
+    name_begin_.append(names_.size());
+    names_.append(record.name);
+    name_end_.append(names_.size());
+    sizes_.append(record.size);
+    seeds_.append(record.seeds);
+    leeches_.append(record.leeches);
+    hashes_.append(record.hash, HASH_SIZE);
+    downloads_.append(record.downloads);
+    updated_.append(record.updated);
+}
+
+ResultRecord::ResultRecord(const RecordFields& fields, QTextCodec* codec):
+    id(fields.field(FIELD_ID).toInt()),
+    size(fields.field(FIELD_SIZE).toLongLong()),
+    seeds(fields.field(FIELD_SEEDS).toInt()),
+    leeches(fields.field(FIELD_LEECHES).toInt()),
+    downloads(fields.field(FIELD_DOWNLOADS).toLongLong()),
+    name(fields.field(FIELD_NAME)) {
+    if (codec) {
+        name = codec->toUnicode(name).toUtf8();
+    }
+    QByteArray hash_bytes = torrent_hash_bytes(QString::fromLatin1(fields.field(FIELD_HASH)));
+    hash_bytes.append(QByteArray(ResultStore::HASH_SIZE - qMin(hash_bytes.size(),
+                                 int(ResultStore::HASH_SIZE)), '\0'));
+    memcpy(hash, hash_bytes.constData(), ResultStore::HASH_SIZE);
+    QDateTime time = parseUpdated(QString::fromLatin1(fields.field(FIELD_UPDATED)).trimmed());
+    updated = time.isValid() ? time.toTime_t() : 0;
+}
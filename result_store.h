@@ -0,0 +1,107 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <QtCore>
+
+struct RecordFields;
+struct ResultRecord;
+
+// Search results as struct of arrays: one array per field, names in one
+// UTF-8 heap, hashes as 20 raw bytes. About 60 bytes per row plus the
+// name. Searches fill small stores which the model appends to its own.
+class ResultStore {
+public:
+    enum {
+        HASH_SIZE = 20
+    };
+
+    void clear();
+
+    int size() const {
+        return ids_.size();
+    }
+
+    // name is UTF-8, hash is 20 bytes
+    void append(int id, const QByteArray& name, qlonglong size,
+                int seeds, int leeches, const QByteArray& hash,
+                qlonglong downloads, uint updated);
+    void append(const ResultStore& other);
+    void append(const ResultRecord& record);
+
+    int id(int row) const {
+        return ids_[row];
+    }
+
+    const char* nameData(int row) const {
+        return names_.constData() + name_begin_[row];
+    }
+
+    int nameSize(int row) const {
+        return name_end_[row] - name_begin_[row];
+    }
+
+    QString name(int row) const {
+        return QString::fromUtf8(nameData(row), nameSize(row));
+    }
+
+    qlonglong torrentSize(int row) const {
+        return sizes_[row];
+    }
+
+    int seeds(int row) const {
+        return seeds_[row];
+    }
+
+    int leeches(int row) const {
+        return leeches_[row];
+    }
+
+    const char* hashData(int row) const {
+        return hashes_.constData() + row * HASH_SIZE;
+    }
+
+    QByteArray hash(int row) const {
+        return QByteArray(hashData(row), HASH_SIZE);
+    }
+
+    qlonglong downloads(int row) const {
+        return downloads_[row];
+    }
+
+    // time_t, 0 if unknown
+    uint updated(int row) const {
+        return updated_[row];
+    }
+
+private:
+    QVector<int> ids_;
+    QVector<qlonglong> sizes_;
+    QVector<int> seeds_;
+    QVector<int> leeches_;
+    QVector<qlonglong> downloads_;
+    QVector<uint> updated_;
+    QByteArray hashes_;
+    QByteArray names_;
+    QVector<int> name_begin_;
+    QVector<int> name_end_;
+};
+
+typedef QSharedPointer<ResultStore> ResultStore_ptr;
+
+// One record of the dump parsed by a scanner, so the store takes it
+// without parsing. The name is UTF-8 and may point into the dump line.
+struct ResultRecord {
+    int id;
+    qlonglong size;
+    int seeds;
+    int leeches;
+    char hash[ResultStore::HASH_SIZE];
+    qlonglong downloads;
+    uint updated; // time_t, 0 if unknown
+    QByteArray name;
+
+    // codec, if given, decodes names which are not UTF-8
+    ResultRecord(const RecordFields& fields, QTextCodec* codec = 0);
+};
+
+#endif // RESULT_STORE_H
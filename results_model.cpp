@@ -0,0 +1,232 @@
+#include "results_model.h"
+#include <QColor>
+#include "search_query.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+QString fileSize(qlonglong size) {
+    if (size > 1024 * 1024 * 1024) {
+        size /= 1024 * 1024 * 1024;
+        return QString::number(size) + " GB";
+    }
+    if (size > 1024 * 1024) {
+        size /= 1024 * 1024;
+        return QString::number(size) + " MB";
+    }
+    if (size > 1024) {
+        size /= 1024;
+        return QString::number(size) + " kB";
+    }
+    return QString::number(size) + " B";
+}
+
+class RowLess {
+public:
+    RowLess(const ResultStore* store, int column):
+        store_(store), column_(column) {
+    }
+
+    bool operator()(int a, int b) const {
+        const ResultStore& s = *store_;
+        switch (column_) {
+        case COLUMN_ID:
+            return s.id(a) < s.id(b);
+        case COLUMN_NAME: {
+            // UTF-8 byte order is code point order
+            int cmp = memcmp(s.nameData(a), s.nameData(b),
+                             qMin(s.nameSize(a), s.nameSize(b)));
+            return cmp < 0 || (cmp == 0 && s.nameSize(a) < s.nameSize(b));
+        }
+        case COLUMN_SIZE:
+            return s.torrentSize(a) < s.torrentSize(b);
+        case COLUMN_SEEDS:
+            return s.seeds(a) < s.seeds(b);
+        case COLUMN_LEECHES:
+            return s.leeches(a) < s.leeches(b);
+        case COLUMN_HASH:
+            return memcmp(s.hashData(a), s.hashData(b), ResultStore::HASH_SIZE) < 0;
+        case COLUMN_DOWNLOADS:
+            return s.downloads(a) < s.downloads(b);
+        case COLUMN_UPDATED:
+            return s.updated(a) < s.updated(b);
+        }
+        return a < b;
+    }
+
+private:
+    const ResultStore* store_;
+    int column_;
+};
+
+class RowGreater {
+public:
+    RowGreater(const ResultStore* store, int column):
+        less_(store, column) {
+    }
+
+    bool operator()(int a, int b) const {
+        return less_(b, a);
+    }
+
+private:
+    RowLess less_;
+};
+
+} // end of anonymous namespace
+
+ResultsModel::ResultsModel(QObject* parent):
+    QAbstractTableModel(parent), base32_(false) {
+}
+
+int ResultsModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : order_.size();
+}
+
+int ResultsModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : COLUMN_COUNT;
+}
+
+QVariant ResultsModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= order_.size()) {
+        return QVariant();
+    }
+    int row = order_[index.row()];
+    int column = index.column();
+    if (role == Qt::DisplayRole) {
+        switch (column) {
+        case COLUMN_ID:
+            return store_.id(row);
+        case COLUMN_NAME:
+            return store_.name(row);
+        case COLUMN_SIZE:
+            return fileSize(store_.torrentSize(row));
+        case COLUMN_SEEDS:
+            return store_.seeds(row);
+        case COLUMN_LEECHES:
+            return store_.leeches(row);
+        case COLUMN_HASH:
+            return torrent_hash_string(store_.hash(row), base32_);
+        case COLUMN_DOWNLOADS:
+            return store_.downloads(row);
+        case COLUMN_UPDATED:
+            if (store_.updated(row)) {
+                return QDateTime::fromTime_t(store_.updated(row));
+            }
+            return QVariant();
+        }
+    } else if (role == Qt::ToolTipRole && column == COLUMN_SIZE) {
+        return store_.torrentSize(row);
+    } else if (role == Qt::ForegroundRole &&
+               (column == COLUMN_ID || column == COLUMN_HASH)) {
+        return QColor(Qt::blue);
+    }
+    return QVariant();
+}
+
+QVariant ResultsModel::headerData(int section, Qt::Orientation orientation,
+                                  int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section) {
+    case COLUMN_ID:
+        return QString::fromUtf8("номер");
+    case COLUMN_NAME:
+        return QString::fromUtf8("название");
+    case COLUMN_SIZE:
+        return QString::fromUtf8("размер");
+    case COLUMN_SEEDS:
+        return QString::fromUtf8("сиды");
+    case COLUMN_LEECHES:
+        return QString::fromUtf8("пиры");
+    case COLUMN_HASH:
+        return QString::fromUtf8("хеш");
+    case COLUMN_DOWNLOADS:
+        return QString::fromUtf8("загрузок");
+    case COLUMN_UPDATED:
+        return QString::fromUtf8("обновлено");
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ResultsModel::flags(const QModelIndex& index) const {
+    if (!index.isValid()) {
+        return 0;
+    }
+    // links are clicked, not selected
+    if (index.column() == COLUMN_ID || index.column() == COLUMN_HASH) {
+        return Qt::ItemIsEnabled;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+void ResultsModel::sort(int column, Qt::SortOrder order) {
+    emit layoutAboutToBeChanged();
+    QModelIndexList old_indexes = persistentIndexList();
+    QVector<int> old_rows;
+    foreach (const QModelIndex& index, old_indexes) {
+        old_rows << order_[index.row()];
+    }
+    if (order == Qt::AscendingOrder) {
+        qStableSort(order_.begin(), order_.end(), RowLess(&store_, column));
+    } else {
+        qStableSort(order_.begin(), order_.end(), RowGreater(&store_, column));
+    }
+    QVector<int> position(order_.size());
+    for (int i = 0; i < order_.size(); i++) {
+        position[order_[i]] = i;
+    }
+    QModelIndexList new_indexes;
+    for (int i = 0; i < old_indexes.size(); i++) {
+        new_indexes << index(position[old_rows[i]], old_indexes[i].column());
+    }
+    changePersistentIndexList(old_indexes, new_indexes);
+    emit layoutChanged();
+}
+
+void ResultsModel::clear() {
+    beginResetModel();
+    store_.clear();
+    order_.clear();
+    endResetModel();
+}
+
+void ResultsModel::addResults(const ResultStore& results) {
+    if (results.size() == 0) {
+        return;
+    }
+    int first = order_.size();
+    beginInsertRows(QModelIndex(), first, first + results.size() - 1);
+    for (int i = 0; i < results.size(); i++) {
+        order_ << store_.size() + i;
+    }
+    store_.append(results);
+    endInsertRows();
+}
+
+void ResultsModel::filter(const SearchQuery& query) {
+    QVector<int> order;
+    foreach (int row, order_) {
+        if (query.matches(QueryRecord(&store_, row))) {
+            order << row;
+        }
+    }
+    if (order.size() == order_.size()) {
+        return;
+    }
+    beginResetModel();
+    order_ = order;
+    endResetModel();
+}
+
+void ResultsModel::setBase32(bool base32) {
+    base32_ = base32;
+    if (!order_.isEmpty()) {
+        emit dataChanged(index(0, COLUMN_HASH), index(order_.size() - 1, COLUMN_HASH));
+    }
+}
+
+QString ResultsModel::hash(int row) const {
+    return torrent_hash_string(store_.hash(order_[row]), base32_);
+}
@@ -0,0 +1,67 @@
+#ifndef RESULTS_MODEL_H
+#define RESULTS_MODEL_H
+
+#include <QtCore>
+#include <QAbstractTableModel>
+#include "result_store.h"
+
+class SearchQuery;
+
+enum {
+    COLUMN_ID,
+    COLUMN_NAME,
+    COLUMN_SIZE,
+    COLUMN_SEEDS,
+    COLUMN_LEECHES,
+    COLUMN_HASH,
+    COLUMN_DOWNLOADS,
+    COLUMN_UPDATED,
+    COLUMN_COUNT
+};
+
+// Table model over ResultStore, cells are formatted only when the view
+// asks for them. Rows of the view map to rows of the store through a
+// permutation, so sorting moves ints only.
+class ResultsModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    ResultsModel(QObject* parent = 0);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex& index) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+    void clear();
+    void addResults(const ResultStore& results);
+    // hides the rows the query does not match, in place; the query must
+    // be built for UTF-8 names
+    void filter(const SearchQuery& query);
+
+    void setBase32(bool base32);
+
+    // accessors by view row
+    int id(int row) const {
+        return store_.id(order_[row]);
+    }
+
+    QString name(int row) const {
+        return store_.name(order_[row]);
+    }
+
+    qlonglong torrentSize(int row) const {
+        return store_.torrentSize(order_[row]);
+    }
+
+    QString hash(int row) const;
+
+private:
+    ResultStore store_;
+    QVector<int> order_; // view row -> store row
+    bool base32_;
+};
+
+#endif // RESULTS_MODEL_H
@@ -0,0 +1,661 @@
+#include "search_query.h"
+#include <climits>
+#include <limits>
+#include "dump_snapshot.h"
+#include "result_store.h"
+#include "hash_index.h"
+#include "id_index.h"
+#include "torrent_hash_convert.h"
+
+namespace {
+
+const qint64 MIN_VALUE = std::numeric_limits<qint64>::min();
+const qint64 MAX_VALUE = std::numeric_limits<qint64>::max();
+
+// relative costs of checking a predicate, cheapest first
+enum {
+    COST_NUMBER = 1,
+    COST_PARSED = 2, // dates and hashes of dump lines are parsed
+    COST_NAME = 3,
+    COST_DECODED_NAME = 4
+};
+
+enum TokenType {
+    TOKEN_WORD,
+    TOKEN_PHRASE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,
+    TOKEN_OPEN,
+    TOKEN_CLOSE
+};
+
+struct Token {
+    TokenType type;
+    QString text;
+
+    Token(TokenType type, const QString& text = QString()):
+        type(type), text(text) {
+    }
+};
+
+QList<Token> tokenize(const QString& text) {
+    QList<Token> tokens;
+    int i = 0;
+    while (i < text.size()) {
+        QChar c = text[i];
+        if (c.isSpace()) {
+            i++;
+        } else if (c == '(' || c == ')') {
+            tokens << Token(c == '(' ? TOKEN_OPEN : TOKEN_CLOSE);
+            i++;
+        } else if (c == '"') {
+            int end = text.indexOf('"', i + 1);
+            if (end < 0) {
+                end = text.size();
+            }
+            tokens << Token(TOKEN_PHRASE, text.mid(i + 1, end - i - 1));
+            i = end + 1;
+        } else {
+            int end = i;
+            while (end < text.size() && !text[end].isSpace() &&
+                   text[end] != '(' && text[end] != ')' && text[end] != '"') {
+                end++;
+            }
+            QString word = text.mid(i, end - i);
+            i = end;
+            if (word == "AND" || word == "&&") {
+                tokens << Token(TOKEN_AND);
+            } else if (word == "OR" || word == "|" || word == "||") {
+                tokens << Token(TOKEN_OR);
+            } else if (word == "NOT") {
+                tokens << Token(TOKEN_NOT);
+            } else if (word.size() > 1 && word[0] == '-') {
+                tokens << Token(TOKEN_NOT) << Token(TOKEN_WORD, word.mid(1));
+            } else {
+                tokens << Token(TOKEN_WORD, word);
+            }
+        }
+    }
+    return tokens;
+}
+
+int fieldByName(const QString& name) {
+    if (name == "id") {
+        return FIELD_ID;
+    } else if (name == "size") {
+        return FIELD_SIZE;
+    } else if (name == "seeds") {
+        return FIELD_SEEDS;
+    } else if (name == "leeches") {
+        return FIELD_LEECHES;
+    } else if (name == "downloads") {
+        return FIELD_DOWNLOADS;
+    } else if (name == "updated") {
+        return FIELD_UPDATED;
+    }
+    return -1;
+}
+
+// Values are periods [start, end]: a number is a period of one, a date
+// covers its year, month or day.
+bool parsePeriod(int field, const QString& text, qint64* start, qint64* end) {
+    if (field == FIELD_UPDATED) {
+        static const QRegExp DATE("(\\d{4})(?:-(\\d{1,2})(?:-(\\d{1,2}))?)?");
+        QRegExp date = DATE;
+        if (!date.exactMatch(text)) {
+            return false;
+        }
+        int year = date.cap(1).toInt();
+        int month = date.cap(2).isEmpty() ? 1 : date.cap(2).toInt();
+        int day = date.cap(3).isEmpty() ? 1 : date.cap(3).toInt();
+        QDate first(year, month, day);
+        if (!first.isValid()) {
+            return false;
+        }
+        QDate next = date.cap(2).isEmpty() ? first.addYears(1) :
+                     date.cap(3).isEmpty() ? first.addMonths(1) : first.addDays(1);
+        // local time, as parseUpdated reads the dump
+        *start = QDateTime(first).toTime_t();
+        *end = qint64(QDateTime(next).toTime_t()) - 1;
+        return true;
+    }
+    static const QRegExp NUMBER("(\\d+(?:\\.\\d+)?)([kmgt]?)b?", Qt::CaseInsensitive);
+    QRegExp number = NUMBER;
+    if (!number.exactMatch(text) || (field != FIELD_SIZE && !number.cap(2).isEmpty())) {
+        return false;
+    }
+    double value = number.cap(1).toDouble();
+    QString unit = number.cap(2).toLower();
+    const char* units = "kmgt";
+    for (int i = 0; i < 4; i++) {
+        if (unit == QChar(units[i])) {
+            value *= double(qint64(1) << (10 * (i + 1)));
+        }
+    }
+    if (value > double(MAX_VALUE / 2)) {
+        return false;
+    }
+    *start = *end = qint64(value);
+    return true;
+}
+
+} // end of anonymous namespace
+
+struct SearchQuery::Node {
+    enum Type {
+        AND, // of no children matches everything
+        OR,
+        NOT,
+        NAME,
+        RANGE,
+        HASH
+    };
+
+    Type type;
+    int cost;
+    QList<Node_ptr> children;
+    QString term;
+    QSharedPointer<NameMatcher> matcher;
+    int field;
+    qint64 low;
+    qint64 high;
+    QByteArray hash;
+
+    Node(Type type):
+        type(type), cost(0), field(-1), low(0), high(0) {
+    }
+
+    static bool cheaper(const Node_ptr& a, const Node_ptr& b) {
+        return a->cost < b->cost;
+    }
+
+    // children of AND and OR are checked cheapest first
+    void addChild(Node_ptr child) {
+        children << child;
+        cost = qMax(cost, child->cost);
+        qStableSort(children.begin(), children.end(), cheaper);
+    }
+};
+
+class SearchQuery::Parser {
+public:
+    Parser(const QString& text, bool cp1251):
+        text_(text), tokens_(tokenize(text)), pos_(0), cp1251_(cp1251) {
+    }
+
+    Node_ptr parse() {
+        // a pasted magnet link is one key, though its name part may hold
+        // spaces and parentheses the tokens would be cut at
+        if (text_.trimmed().startsWith("magnet:", Qt::CaseInsensitive)) {
+            QByteArray bytes = HashIndex::parseHash(text_);
+            if (!bytes.isEmpty()) {
+                return hash(bytes);
+            }
+        }
+        Node_ptr root = parseOr();
+        // stray closing parentheses are skipped
+        while (pos_ < tokens_.size()) {
+            pos_++;
+            Node_ptr more = parseOr();
+            Node_ptr both(new Node(Node::AND));
+            both->addChild(root);
+            both->addChild(more);
+            root = both;
+        }
+        return root;
+    }
+
+private:
+    QString text_;
+    QList<Token> tokens_;
+    int pos_;
+    bool cp1251_;
+
+    bool peek(TokenType type) const {
+        return pos_ < tokens_.size() && tokens_[pos_].type == type;
+    }
+
+    Node_ptr single(Node_ptr node) {
+        if (node->children.size() == 1) {
+            return node->children[0];
+        }
+        return node;
+    }
+
+    Node_ptr parseOr() {
+        Node_ptr node(new Node(Node::OR));
+        while (true) {
+            Node_ptr child = parseAnd();
+            // "a OR" is a, not everything
+            if (child->type != Node::AND || !child->children.isEmpty()) {
+                node->addChild(child);
+            }
+            if (!peek(TOKEN_OR)) {
+                break;
+            }
+            pos_++;
+        }
+        if (node->children.isEmpty()) {
+            return Node_ptr(new Node(Node::AND));
+        }
+        return single(node);
+    }
+
+    Node_ptr parseAnd() {
+        Node_ptr node(new Node(Node::AND));
+        while (pos_ < tokens_.size() && !peek(TOKEN_OR) && !peek(TOKEN_CLOSE)) {
+            if (peek(TOKEN_AND)) {
+                pos_++;
+                continue;
+            }
+            Node_ptr child = parseUnary();
+            if (child) {
+                node->addChild(child);
+            }
+        }
+        return single(node);
+    }
+
+    Node_ptr parseUnary() {
+        const Token& token = tokens_[pos_++];
+        if (token.type == TOKEN_NOT) {
+            if (pos_ >= tokens_.size() || peek(TOKEN_OR) || peek(TOKEN_CLOSE)) {
+                return name("NOT");
+            }
+            Node_ptr child = parseUnary();
+            if (!child) {
+                return Node_ptr();
+            }
+            Node_ptr node(new Node(Node::NOT));
+            node->addChild(child);
+            return node;
+        }
+        if (token.type == TOKEN_OPEN) {
+            Node_ptr node = parseOr();
+            if (peek(TOKEN_CLOSE)) {
+                pos_++;
+            }
+            return node;
+        }
+        if (token.type == TOKEN_PHRASE) {
+            return token.text.isEmpty() ? Node_ptr() : name(token.text);
+        }
+        if (token.type != TOKEN_WORD) {
+            return Node_ptr();
+        }
+        return word(token.text);
+    }
+
+    Node_ptr name(const QString& term) {
+        Node_ptr node(new Node(Node::NAME));
+        node->term = term;
+        node->matcher = QSharedPointer<NameMatcher>(new NameMatcher(term, cp1251_));
+        node->cost = node->matcher->isBytewise() ? COST_NAME : COST_DECODED_NAME;
+        return node;
+    }
+
+    Node_ptr hash(const QByteArray& bytes) {
+        Node_ptr node(new Node(Node::HASH));
+        node->hash = bytes;
+        node->cost = COST_PARSED;
+        return node;
+    }
+
+    Node_ptr range(int field, qint64 low, qint64 high) {
+        Node_ptr node(new Node(Node::RANGE));
+        node->field = field;
+        node->low = low;
+        node->high = high;
+        node->cost = field == FIELD_UPDATED ? COST_PARSED : COST_NUMBER;
+        return node;
+    }
+
+    Node_ptr word(const QString& text) {
+        static const QRegExp PREDICATE("([a-z]+)(:|=|<=|>=|<|>)(.*)", Qt::CaseInsensitive);
+        QRegExp predicate = PREDICATE;
+        if (predicate.exactMatch(text)) {
+            Node_ptr node = fieldPredicate(predicate.cap(1).toLower(),
+                                           predicate.cap(2), predicate.cap(3));
+            if (node) {
+                return node;
+            }
+        }
+        // pasted info-hashes, magnet links and topic links
+        QByteArray bytes = HashIndex::parseHash(text);
+        if (!bytes.isEmpty()) {
+            return hash(bytes);
+        }
+        if (text.contains("viewtopic.php?t=")) {
+            int id = IdIndex::parseTopicId(text);
+            if (id >= 0) {
+                return range(FIELD_ID, id, id);
+            }
+        }
+        return name(text);
+    }
+
+    Node_ptr fieldPredicate(const QString& field_name, const QString& op,
+                            const QString& value) {
+        if (field_name == "hash") {
+            QByteArray bytes = HashIndex::parseHash(value);
+            return op == ":" && !bytes.isEmpty() ? hash(bytes) : Node_ptr();
+        }
+        int field = fieldByName(field_name);
+        if (field < 0) {
+            return Node_ptr();
+        }
+        qint64 start, end;
+        if ((op == ":" || op == "=") && value.contains("..")) {
+            QString from = value.section("..", 0, 0);
+            QString to = value.section("..", 1);
+            qint64 low = MIN_VALUE;
+            qint64 high = MAX_VALUE;
+            if (!from.isEmpty()) {
+                if (!parsePeriod(field, from, &start, &end)) {
+                    return Node_ptr();
+                }
+                low = start;
+            }
+            if (!to.isEmpty()) {
+                if (!parsePeriod(field, to, &start, &end)) {
+                    return Node_ptr();
+                }
+                high = end;
+            }
+            return range(field, low, high);
+        }
+        if (!parsePeriod(field, value, &start, &end)) {
+            return Node_ptr();
+        }
+        if (op == ">") {
+            return range(field, end + 1, MAX_VALUE);
+        } else if (op == ">=") {
+            return range(field, start, MAX_VALUE);
+        } else if (op == "<") {
+            return range(field, MIN_VALUE, start - 1);
+        } else if (op == "<=") {
+            return range(field, MIN_VALUE, end);
+        }
+        return range(field, start, end);
+    }
+};
+
+QueryRecord::QueryRecord(const DumpSnapshot* snapshot, int row):
+    snapshot_(snapshot), results_(0), row_(row), fields_(0) {
+}
+
+QueryRecord::QueryRecord(const RecordFields* fields):
+    snapshot_(0), results_(0), row_(-1), fields_(fields) {
+}
+
+QueryRecord::QueryRecord(const ResultStore* results, int row):
+    snapshot_(0), results_(results), row_(row), fields_(0) {
+}
+
+qint64 QueryRecord::number(int field) const {
+    if (snapshot_) {
+        switch (field) {
+        case FIELD_ID:
+            return snapshot_->id(row_);
+        case FIELD_SIZE:
+            return snapshot_->torrentSize(row_);
+        case FIELD_SEEDS:
+            return snapshot_->seeds(row_);
+        case FIELD_LEECHES:
+            return snapshot_->leeches(row_);
+        case FIELD_DOWNLOADS:
+            return snapshot_->downloads(row_);
+        case FIELD_UPDATED:
+            return snapshot_->updated(row_);
+        }
+        return 0;
+    }
+    if (results_) {
+        switch (field) {
+        case FIELD_ID:
+            return results_->id(row_);
+        case FIELD_SIZE:
+            return results_->torrentSize(row_);
+        case FIELD_SEEDS:
+            return results_->seeds(row_);
+        case FIELD_LEECHES:
+            return results_->leeches(row_);
+        case FIELD_DOWNLOADS:
+            return results_->downloads(row_);
+        case FIELD_UPDATED:
+            return results_->updated(row_);
+        }
+        return 0;
+    }
+    if (field == FIELD_UPDATED) {
+        QDateTime updated = parseUpdated(QString::fromLatin1(fields_->field(field)).trimmed());
+        return updated.isValid() ? updated.toTime_t() : 0;
+    }
+    return fields_->field(field).toLongLong();
+}
+
+QByteArray QueryRecord::hash() const {
+    if (snapshot_) {
+        return QByteArray::fromRawData(snapshot_->hashData(row_), DumpSnapshot::HASH_SIZE);
+    }
+    if (results_) {
+        return QByteArray::fromRawData(results_->hashData(row_), ResultStore::HASH_SIZE);
+    }
+    return torrent_hash_bytes(QString::fromLatin1(fields_->field(FIELD_HASH)));
+}
+
+const char* QueryRecord::name(int* size) const {
+    if (snapshot_) {
+        *size = snapshot_->nameSize(row_);
+        return snapshot_->nameData(row_);
+    }
+    if (results_) {
+        *size = results_->nameSize(row_);
+        return results_->nameData(row_);
+    }
+    *size = fields_->size[FIELD_NAME];
+    return fields_->begin[FIELD_NAME];
+}
+
+SearchQuery::SearchQuery(const QString& text, bool cp1251):
+    root_(Parser(text, cp1251).parse()) {
+}
+
+bool SearchQuery::matches(const QueryRecord& record) const {
+    return matches(*root_, record);
+}
+
+bool SearchQuery::matches(const Node& node, const QueryRecord& record) {
+    switch (node.type) {
+    case Node::AND:
+        foreach (const Node_ptr& child, node.children) {
+            if (!matches(*child, record)) {
+                return false;
+            }
+        }
+        return true;
+    case Node::OR:
+        foreach (const Node_ptr& child, node.children) {
+            if (matches(*child, record)) {
+                return true;
+            }
+        }
+        return false;
+    case Node::NOT:
+        return !matches(*node.children[0], record);
+    case Node::NAME: {
+        int size;
+        const char* name = record.name(&size);
+        return node.matcher->matches(name, size);
+    }
+    case Node::RANGE: {
+        qint64 value = record.number(node.field);
+        return value >= node.low && value <= node.high;
+    }
+    case Node::HASH:
+        return record.hash() == node.hash;
+    }
+    return false;
+}
+
+bool SearchQuery::refines(const SearchQuery& previous) const {
+    return within(*root_, *previous.root_);
+}
+
+// Sufficient conditions only, checked from the outside in.
+bool SearchQuery::within(const Node& a, const Node& b) {
+    if (b.type == Node::AND) {
+        foreach (const Node_ptr& child, b.children) {
+            if (!within(a, *child)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (a.type == Node::OR) {
+        foreach (const Node_ptr& child, a.children) {
+            if (!within(*child, b)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (a.type == Node::AND) {
+        foreach (const Node_ptr& child, a.children) {
+            if (within(*child, b)) {
+                return true;
+            }
+        }
+        // "x y" is within "x OR z" through x
+    }
+    if (b.type == Node::OR) {
+        foreach (const Node_ptr& child, b.children) {
+            if (within(a, *child)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+    case Node::NOT:
+        return within(*b.children[0], *a.children[0]);
+    case Node::NAME:
+        // a name containing "matrix" contains "matr"
+        return a.term.toLower().contains(b.term.toLower());
+    case Node::RANGE:
+        return a.field == b.field && a.low >= b.low && a.high <= b.high;
+    case Node::HASH:
+        return a.hash == b.hash;
+    default:
+        return false;
+    }
+}
+
+bool SearchQuery::keys(QSet<QByteArray>* hashes, QSet<int>* ids) const {
+    return keys(*root_, hashes, ids);
+}
+
+bool SearchQuery::keys(const Node& node, QSet<QByteArray>* hashes, QSet<int>* ids) {
+    switch (node.type) {
+    case Node::HASH:
+        *hashes << node.hash;
+        return true;
+    case Node::RANGE:
+        if (node.field == FIELD_ID && node.low == node.high &&
+            node.low >= 0 && node.low <= INT_MAX) {
+            *ids << int(node.low);
+            return true;
+        }
+        return false;
+    case Node::AND:
+        // any keyed child narrows down the whole
+        foreach (const Node_ptr& child, node.children) {
+            QSet<QByteArray> child_hashes;
+            QSet<int> child_ids;
+            if (keys(*child, &child_hashes, &child_ids)) {
+                *hashes += child_hashes;
+                *ids += child_ids;
+                return true;
+            }
+        }
+        return false;
+    case Node::OR: {
+        QSet<QByteArray> all_hashes;
+        QSet<int> all_ids;
+        foreach (const Node_ptr& child, node.children) {
+            if (!keys(*child, &all_hashes, &all_ids)) {
+                return false;
+            }
+        }
+        *hashes += all_hashes;
+        *ids += all_ids;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool SearchQuery::nameTerms(QStringList* terms) const {
+    return nameTerms(*root_, terms);
+}
+
+bool SearchQuery::nameTerms(const Node& node, QStringList* terms) {
+    switch (node.type) {
+    case Node::NAME:
+        if (node.term.isEmpty()) {
+            return false;
+        }
+        *terms << node.term;
+        return true;
+    case Node::AND: {
+        // the child whose shortest term is longest is the most selective
+        QStringList best;
+        int best_length = 0;
+        foreach (const Node_ptr& child, node.children) {
+            QStringList child_terms;
+            if (!nameTerms(*child, &child_terms)) {
+                continue;
+            }
+            int length = INT_MAX;
+            foreach (const QString& term, child_terms) {
+                length = qMin(length, term.size());
+            }
+            if (length > best_length) {
+                best = child_terms;
+                best_length = length;
+            }
+        }
+        *terms += best;
+        return !best.isEmpty();
+    }
+    case Node::OR: {
+        QStringList all;
+        foreach (const Node_ptr& child, node.children) {
+            if (!nameTerms(*child, &all)) {
+                return false;
+            }
+        }
+        *terms += all;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+int SearchQuery::numberField(const QString& name) {
+    return fieldByName(name);
+}
+
+QString SearchQuery::anchorTerm() const {
+    QStringList terms;
+    if (nameTerms(&terms) && terms.size() == 1) {
+        return terms[0];
+    }
+    return QString();
+}
@@ -0,0 +1,90 @@
+#ifndef SEARCH_QUERY_H
+#define SEARCH_QUERY_H
+
+#include <QtCore>
+#include "dump_line.h"
+#include "name_matcher.h"
+
+class DumpSnapshot;
+class ResultStore;
+
+// Query language of the search box:
+//
+//   word "quoted phrase"     name contains it, case insensitive
+//   a b, a AND b             both
+//   a OR b, a | b            either
+//   NOT a, -a                not
+//   ( ... )                  grouping
+//   size>4G seeds>=10        numeric fields: id, size (K, M, G, T),
+//   leeches<5 downloads:100  seeds, leeches, downloads; ops : = < <= > >=
+//   size:1G..4G              inclusive range, either end may be left out
+//   updated:2012..2013       dates as yyyy, yyyy-mm or yyyy-mm-dd
+//   id:123, topic link       the topic
+//   hash:H, H, magnet link   info-hash, hex or base32
+//
+// Anything that does not parse is taken as a word of the name. The
+// compiled query checks cheap fields first and the name last.
+
+// Fields of one record, from a snapshot row, a split dump line or a row
+// of found results.
+class QueryRecord {
+public:
+    QueryRecord(const DumpSnapshot* snapshot, int row);
+    QueryRecord(const RecordFields* fields);
+    // the name is UTF-8, so the query must be built without cp1251
+    QueryRecord(const ResultStore* results, int row);
+
+    // id, size, seeds, leeches, downloads or updated (time_t, 0 if unknown)
+    qint64 number(int field) const;
+    // 20 bytes
+    QByteArray hash() const;
+    // raw name in the dump encoding
+    const char* name(int* size) const;
+
+private:
+    const DumpSnapshot* snapshot_;
+    const ResultStore* results_;
+    int row_;
+    const RecordFields* fields_;
+};
+
+class SearchQuery {
+public:
+    SearchQuery(const QString& text, bool cp1251 = false);
+
+    bool matches(const QueryRecord& record) const;
+
+    // true if every hit of this query is a hit of the previous one, so
+    // the hits of that can be filtered instead of searching again;
+    // false when it is not obvious from the two queries
+    bool refines(const SearchQuery& previous) const;
+
+    // keys one of which every hit has; false if there are none
+    bool keys(QSet<QByteArray>* hashes, QSet<int>* ids) const;
+
+    // name terms one of which every hit contains; false if there are none
+    bool nameTerms(QStringList* terms) const;
+
+    // the only name term every hit contains, empty if there is none
+    QString anchorTerm() const;
+
+    // the numeric field of dump_line.h called so in queries ("downloads"),
+    // -1 if there is none
+    static int numberField(const QString& name);
+
+private:
+    struct Node;
+    typedef QSharedPointer<Node> Node_ptr;
+
+    class Parser;
+
+    Node_ptr root_;
+
+    static bool matches(const Node& node, const QueryRecord& record);
+    // true if the hits of a are among the hits of b
+    static bool within(const Node& a, const Node& b);
+    static bool keys(const Node& node, QSet<QByteArray>* hashes, QSet<int>* ids);
+    static bool nameTerms(const Node& node, QStringList* terms);
+};
+
+#endif // SEARCH_QUERY_H
@@ -0,0 +1,775 @@
+#include "searching_thread.h"
+#include <climits>
+#include <algorithm>
+#include "name_index.h"
+#include "dump_snapshot.h"
+#include "hash_index.h"
+#include "id_index.h"
+#include "gzip_index.h"
+#include "gzip_pipeline.h"
+#include "dump_line.h"
+#include "quazip/quagzipfile.h"
+
+typedef QSharedPointer<GzipIndex> GzipIndex_ptr;
+
+// Newline aligned byte ranges of the dump, taken one by one by the
+// coordinating SearchingThread and by helper tasks of the global pool.
+// Helpers which start after all ranges were taken exit without touching
+// the search, so the queue outlives the search through QSharedPointer.
+// Ranges of compressed dumps start at gzip index points.
+class ChunkQueue {
+public:
+    ChunkQueue(SearchingThread* search, QString path, QVector<qint64> bounds):
+        search_(search), path_(path), bounds_(bounds), done_(0) {
+    }
+
+    ChunkQueue(SearchingThread* search, QString path, GzipIndex_ptr gz_index,
+               QVector<int> points):
+        search_(search), path_(path), gz_index_(gz_index), points_(points), done_(0) {
+        foreach (int point, points) {
+            bounds_ << gz_index->pointOffset(point);
+        }
+        bounds_ << gz_index->uncompressedSize();
+    }
+
+    int chunks() const {
+        return bounds_.size() - 1;
+    }
+
+    void work() {
+        QFile file(path_);
+        QScopedPointer<GzipIndexReader> reader;
+        while (true) {
+            int i = next_.fetchAndAddOrdered(1);
+            if (i >= chunks()) {
+                return;
+            }
+            if (search_->keepSearching()) {
+                if (gz_index_) {
+                    if (!reader) {
+                        reader.reset(new GzipIndexReader(path_, gz_index_.data()));
+                    }
+                    search_->scanGzRange(reader.data(), *gz_index_, points_[i], bounds_[i + 1]);
+                } else if (file.isOpen() || file.open(QIODevice::ReadOnly)) {
+                    search_->scanRange(&file, bounds_[i], bounds_[i + 1]);
+                }
+            }
+            QMutexLocker locker(&mutex_);
+            done_ += 1;
+            if (done_ == chunks()) {
+                all_done_.wakeAll();
+            }
+        }
+    }
+
+    void waitDone() {
+        QMutexLocker locker(&mutex_);
+        while (done_ < chunks()) {
+            all_done_.wait(&mutex_);
+        }
+    }
+
+private:
+    SearchingThread* search_;
+    QString path_;
+    QVector<qint64> bounds_;
+    GzipIndex_ptr gz_index_;
+    QVector<int> points_;
+    QAtomicInt next_;
+    QMutex mutex_;
+    QWaitCondition all_done_;
+    int done_;
+};
+
+typedef QSharedPointer<ChunkQueue> ChunkQueue_ptr;
+typedef QSharedPointer<GzipPipeline> GzipPipeline_ptr;
+
+class ChunkTask : public QRunnable {
+public:
+    ChunkTask(ChunkQueue_ptr queue):
+        queue_(queue) {
+    }
+
+    void run() {
+        queue_->work();
+    }
+
+private:
+    ChunkQueue_ptr queue_;
+};
+
+// Helper consuming blocks of the gzip pipeline. The search is touched only
+// while a block is taken: scanPipeline() waits for all taken blocks to be
+// released, so helpers which start after the last block exit on next()
+// without touching the search, which may be gone by then.
+class PipelineTask : public QRunnable {
+public:
+    PipelineTask(SearchingThread* search, GzipPipeline_ptr pipeline):
+        search_(search), pipeline_(pipeline) {
+    }
+
+    void run() {
+        GzipPipeline::Block block;
+        while (pipeline_->next(&block)) {
+            bool keep = search_->scanBlock(block);
+            pipeline_->release(block);
+            if (!keep) {
+                pipeline_->cancel();
+            }
+        }
+    }
+
+private:
+    SearchingThread* search_;
+    GzipPipeline_ptr pipeline_;
+};
+
+namespace {
+
+// QThread::msleep is protected in Qt 4
+class Sleeper : public QThread {
+public:
+    static void msleep(unsigned long ms) {
+        QThread::msleep(ms);
+    }
+};
+
+// end of the last complete line in [begin, end), or begin
+const char* lastLineEnd(const char* begin, const char* end) {
+    const char* last = end;
+    while (last > begin && last[-1] != '\n') {
+        last--;
+    }
+    return last;
+}
+
+} // end of anonymous namespace
+
+SearchingThread::SearchingThread(QIODevice* input, int limit, QString pattern, bool cp1251):
+    input_(input), limit_(limit), cp1251_(cp1251),
+    codec_(QTextCodec::codecForName(cp1251 ? "Windows-1251" : "UTF-8")),
+    query_(pattern, cp1251),
+    anchored_(!query_.anchorTerm().isEmpty()),
+    matcher_(query_.anchorTerm(), cp1251),
+    top_field_(-1), top_ascending_(false), plan_(PLAN_NONE) {
+}
+
+void SearchingThread::setHashes(const QSet<QByteArray>& hashes) {
+    hashes_ = hashes;
+}
+
+void SearchingThread::setTopicIds(const QSet<int>& ids) {
+    ids_ = ids;
+}
+
+void SearchingThread::setSnapshot(DumpSnapshot_ptr snapshot) {
+    snapshot_ = snapshot;
+}
+
+void SearchingThread::setRing(ResultRing_ptr ring) {
+    ring_ = ring;
+}
+
+void SearchingThread::stop() {
+    cancelled_.fetchAndStoreOrdered(1);
+    stopped_.fetchAndStoreOrdered(1);
+}
+
+// A full ring means the window is behind; the producer backs off and
+// checks for cancel in between, the window never waits for it.
+void SearchingThread::deliver(ResultStore_ptr results) {
+    static const int PUSH_BACKOFF = 2; // ms
+    QMutexLocker locker(&deliver_mutex_);
+    if (!ring_) {
+        emit newResults(results);
+        return;
+    }
+    while (!ring_->push(results) && cancelled_ == 0) {
+        Sleeper::msleep(PUSH_BACKOFF);
+    }
+}
+
+void SearchingThread::fail(const QString& path) {
+    qDebug() << "search stopped on a broken dump" << path;
+    broken_.fetchAndStoreOrdered(1);
+    stopped_.fetchAndStoreOrdered(1);
+}
+
+void SearchingThread::setTopBy(int field, bool ascending) {
+    top_field_ = field;
+    top_ascending_ = ascending;
+}
+
+void SearchingThread::run() {
+    if (limit_ <= 0) {
+        emit stopFilling();
+        return;
+    }
+    hits_ = 0;
+    broken_ = 0;
+    chunk_ = ResultStore_ptr(new ResultStore);
+    chunk_limit_ = 5;
+    top_.clear();
+    top_floor_ = INT_MIN;
+    QFile* file = qobject_cast<QFile*>(input_);
+    QuaGzipFile* gz_file = qobject_cast<QuaGzipFile*>(input_);
+    GzipIndex_ptr gz_index;
+    if (gz_file) {
+        gz_index = GzipIndex_ptr(new GzipIndex);
+        if (!gz_index->load(gz_file->getFileName())) {
+            gz_index.clear();
+        }
+    }
+    QString path = file ? file->fileName() : gz_file ? gz_file->getFileName() : QString();
+    DumpSnapshot_ptr snapshot = snapshot_;
+    if (!snapshot) {
+        snapshot = DumpSnapshot_ptr(new DumpSnapshot);
+        if (!snapshot->open(path)) {
+            snapshot.clear();
+        }
+    }
+    bool has_snapshot = snapshot;
+    NameIndex index;
+    QVector<qint64> offsets;
+    // Offsets come from the key indexes or else from the name index; the
+    // snapshot, if any, gives their rows, otherwise the lines are read
+    // back. The name index is built from UTF-8 names, and offsets into
+    // compressed dumps are reachable only through the gzip index. The
+    // snapshot keeps raw names and fits any encoding, so it is scanned
+    // when no index narrows the search down.
+    bool reachable = has_snapshot || file || gz_index;
+    if (reachable && keyOffsets(path, &offsets)) {
+        plan_ = PLAN_KEYS;
+    } else if (reachable && !hasKeys() && !cp1251_ && index.open(path) &&
+               termOffsets(index, &offsets)) {
+        plan_ = PLAN_NAME_INDEX;
+    } else if (has_snapshot) {
+        plan_ = PLAN_SNAPSHOT;
+    } else {
+        plan_ = PLAN_SCAN;
+    }
+    if (plan_ == PLAN_KEYS || plan_ == PLAN_NAME_INDEX) {
+        QScopedPointer<GzipIndexReader> reader;
+        if (!has_snapshot && !file) {
+            reader.reset(new GzipIndexReader(path, gz_index.data()));
+        }
+        lookupOffsets(offsets, snapshot.data(), file, reader.data());
+    } else if (plan_ == PLAN_SNAPSHOT) {
+        scanSnapshot(*snapshot);
+    } else if (file) {
+        scanParallel(file);
+    } else if (gz_index) {
+        scanParallelGz(path, gz_index);
+    } else if (!gz_file || !scanPipeline(path)) {
+        QByteArray line_byte;
+        while(0!=(line_byte=input_->readLine())) {
+            if (!processLine(line_byte.constData(), line_byte.size())) {
+                break;
+            }
+        }
+    }
+    if (top_field_ >= 0) {
+        emitTop(snapshot.data());
+    }
+    if (chunk_->size() > 0) {
+        deliver(chunk_);
+    }
+    emit stopFilling();
+}
+
+bool SearchingThread::wanted(const QueryRecord& record) const {
+    if (!hashes_.isEmpty()) {
+        return hashes_.contains(record.hash());
+    }
+    if (!ids_.isEmpty()) {
+        return ids_.contains(int(record.number(FIELD_ID)));
+    }
+    return query_.matches(record);
+}
+
+bool SearchingThread::keyOffsets(const QString& path, QVector<qint64>* offsets) {
+    QSet<QByteArray> hashes = hashes_;
+    QSet<int> ids = ids_;
+    if (!hasKeys() && !query_.keys(&hashes, &ids)) {
+        return false;
+    }
+    // the query may name both; each needs its index
+    HashIndex hash_index;
+    IdIndex id_index;
+    if ((!hashes.isEmpty() && !hash_index.open(path)) ||
+        (!ids.isEmpty() && !id_index.open(IdIndex::dumpIndexPath(path), QFileInfo(path)))) {
+        return false;
+    }
+    foreach (const QByteArray& hash, hashes) {
+        *offsets += hash_index.find(hash);
+    }
+    foreach (int id, ids) {
+        qint64 offset = id_index.offset(id);
+        if (offset >= 0) {
+            *offsets << offset;
+        }
+    }
+    // a record of both a wanted hash and a wanted id comes once
+    qSort(offsets->begin(), offsets->end());
+    offsets->erase(std::unique(offsets->begin(), offsets->end()), offsets->end());
+    return true;
+}
+
+bool SearchingThread::termOffsets(const NameIndex& index, QVector<qint64>* offsets) {
+    QStringList terms;
+    if (!query_.nameTerms(&terms)) {
+        return false;
+    }
+    foreach (const QString& term, terms) {
+        QVector<qint64> term_offsets;
+        if (!index.candidates(term, &term_offsets)) {
+            return false;
+        }
+        *offsets += term_offsets;
+    }
+    if (terms.size() > 1) {
+        qSort(offsets->begin(), offsets->end());
+        offsets->erase(std::unique(offsets->begin(), offsets->end()), offsets->end());
+    }
+    return true;
+}
+
+void SearchingThread::lookupOffsets(const QVector<qint64>& offsets, const DumpSnapshot* snapshot,
+                                    QFile* file, GzipIndexReader* reader) {
+    qDebug() << (plan_ == PLAN_KEYS ? "key lookup:" : "indexed search:")
+             << offsets.size() << "candidates";
+    ResultStore_ptr results(new ResultStore);
+    foreach (qint64 offset, offsets) {
+        bool keep;
+        if (snapshot) {
+            int row = snapshot->rowAtOffset(offset);
+            keep = row < 0 || !wanted(QueryRecord(snapshot, row)) ||
+                   addSnapshotRow(*snapshot, row, results);
+        } else {
+            QByteArray line_byte;
+            if (reader ? reader->seek(offset) : file->seek(offset)) {
+                line_byte = reader ? reader->readLine() : file->readLine();
+            }
+            if (reader && reader->failed()) {
+                fail(reader->fileName());
+                break;
+            }
+            keep = processLine(line_byte.constData(), line_byte.size());
+        }
+        if (!keep) {
+            break;
+        }
+    }
+    deliver(results);
+}
+
+// The name heap holds the raw names only, so the matcher runs over a
+// fraction of the dump and nothing else is parsed.
+void SearchingThread::scanSnapshot(const DumpSnapshot& snapshot) {
+    qDebug() << "snapshot search:" << snapshot.rowCount() << "rows";
+    ResultStore_ptr results(new ResultStore);
+    const char* heap = snapshot.heap();
+    qint64 heap_size = snapshot.heapSize();
+    if (!hasKeys() && anchored_ && matcher_.isBytewise() && heap_size <= INT_MAX) {
+        const char* p = heap;
+        const char* end = heap + heap_size;
+        while (p < end) {
+            const char* hit = matcher_.find(p, end - p);
+            if (!hit) {
+                break;
+            }
+            int row = snapshot.rowAt(hit - heap);
+            if (query_.matches(QueryRecord(&snapshot, row)) &&
+                !addSnapshotRow(snapshot, row, results)) {
+                break;
+            }
+            // past the '\n' after the name
+            p = snapshot.nameData(row) + snapshot.nameSize(row) + 1;
+        }
+    } else {
+        for (int row = 0; row < snapshot.rowCount(); row++) {
+            if (wanted(QueryRecord(&snapshot, row)) &&
+                !addSnapshotRow(snapshot, row, results)) {
+                break;
+            }
+        }
+    }
+    deliver(results);
+}
+
+bool SearchingThread::addSnapshotRow(const DumpSnapshot& snapshot, int row,
+                                     ResultStore_ptr& results) {
+    static const int RESULTS_CHUNK = 1000;
+    if (top_field_ >= 0) {
+        return keepSearching() &&
+               addTop(QueryRecord(&snapshot, row).number(top_field_), snapshot.id(row), row, 0, 0);
+    }
+    if (!keepSearching() || hits_ >= limit_) {
+        return false;
+    }
+    QByteArray name = QByteArray::fromRawData(snapshot.nameData(row), snapshot.nameSize(row));
+    if (cp1251_) {
+        name = codec_->toUnicode(name).toUtf8();
+    }
+    results->append(snapshot.id(row), name, snapshot.torrentSize(row),
+                    snapshot.seeds(row), snapshot.leeches(row),
+                    QByteArray::fromRawData(snapshot.hashData(row), DumpSnapshot::HASH_SIZE),
+                    snapshot.downloads(row), snapshot.updated(row));
+    hits_ += 1;
+    if (results->size() >= RESULTS_CHUNK) {
+        deliver(results);
+        results = ResultStore_ptr(new ResultStore);
+    }
+    return hits_ < limit_;
+}
+
+// Splits the dump into newline aligned ranges scanned on all cores.
+void SearchingThread::scanParallel(QFile* file) {
+    static const qint64 MIN_CHUNK_SIZE = 16 * 1024 * 1024;
+    int threads = qMax(1, QThread::idealThreadCount());
+    qint64 file_size = file->size();
+    // a few chunks per thread balance fast and slow ranges
+    int chunks = qMax(qint64(1), qMin(qint64(threads * 4), file_size / MIN_CHUNK_SIZE));
+    QVector<qint64> bounds;
+    bounds << 0;
+    for (int i = 1; i < chunks; i++) {
+        qint64 bound = file_size * i / chunks;
+        if (bound <= bounds.last() || !file->seek(bound)) {
+            continue;
+        }
+        bound += file->readLine().size();
+        if (bound > bounds.last() && bound < file_size) {
+            bounds << bound;
+        }
+    }
+    bounds << file_size;
+    runQueue(ChunkQueue_ptr(new ChunkQueue(this, file->fileName(), bounds)));
+}
+
+// Splits a compressed dump at gzip index points, every range is
+// inflated independently.
+void SearchingThread::scanParallelGz(const QString& path, QSharedPointer<GzipIndex> index) {
+    int threads = qMax(1, QThread::idealThreadCount());
+    int step = qMax(1, index->size() / (threads * 4));
+    QVector<int> points;
+    for (int point = 0; point < index->size(); point += step) {
+        points << point;
+    }
+    runQueue(ChunkQueue_ptr(new ChunkQueue(this, path, index, points)));
+}
+
+void SearchingThread::runQueue(QSharedPointer<ChunkQueue> queue) {
+    int threads = qMax(1, QThread::idealThreadCount());
+    qDebug() << "parallel scan:" << queue->chunks() << "chunks";
+    int helpers = qMin(queue->chunks(), threads) - 1;
+    for (int i = 0; i < helpers; i++) {
+        QThreadPool::globalInstance()->start(new ChunkTask(queue));
+    }
+    queue->work();
+    queue->waitDone();
+}
+
+// Inflates a compressed dump without an index ahead of the scanners.
+bool SearchingThread::scanPipeline(const QString& path) {
+    GzipPipeline_ptr pipeline(new GzipPipeline(path));
+    if (!pipeline->start()) {
+        return false;
+    }
+    int threads = qMax(1, QThread::idealThreadCount());
+    for (int i = 0; i < threads - 1; i++) {
+        QThreadPool::globalInstance()->start(new PipelineTask(this, pipeline));
+    }
+    GzipPipeline::Block block;
+    while (pipeline->next(&block)) {
+        bool keep = scanBlock(block);
+        pipeline->release(block);
+        if (!keep) {
+            pipeline->cancel();
+        }
+    }
+    // next() fails for good once it failed here, so no helper can take
+    // a block after the taken ones are released
+    pipeline->waitIdle();
+    if (pipeline->failed()) {
+        fail(path);
+    }
+    return true;
+}
+
+bool SearchingThread::scanBlock(const GzipPipeline::Block& block) {
+    return keepSearching() &&
+           (block.joined.isEmpty() ||
+            processLine(block.joined.constData(), block.joined.size())) &&
+           scanLines(block.data, block.data + block.size);
+}
+
+// Walks [begin, end) of the uncompressed dump through memory mapped
+// windows. Windows keep the address space usage bounded.
+bool SearchingThread::scanRange(QFile* file, qint64 begin_offset, qint64 end_offset) {
+    static const qint64 WINDOW_SIZE = 64 * 1024 * 1024;
+    qint64 offset = begin_offset;
+    while (offset < end_offset) {
+        if (!keepSearching()) {
+            return false;
+        }
+        qint64 window = qMin(WINDOW_SIZE, end_offset - offset);
+        uchar* map = file->map(offset, window);
+        if (!map) {
+            qDebug() << "can not map" << file->fileName() << offset;
+            if (!file->seek(offset)) {
+                return false;
+            }
+            QByteArray line_byte;
+            while (file->pos() < end_offset && 0!=(line_byte=file->readLine())) {
+                if (!processLine(line_byte.constData(), line_byte.size())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        const char* begin = (const char*)map;
+        const char* end = begin + window;
+        if (offset + window < end_offset) {
+            // leave the last incomplete line to the next window
+            const char* last = lastLineEnd(begin, end);
+            if (last > begin) {
+                end = last;
+            }
+        }
+        bool keep = scanLines(begin, end);
+        file->unmap(map);
+        if (!keep) {
+            return false;
+        }
+        offset += end - begin;
+    }
+    return true;
+}
+
+// Inflates the compressed dump from an index point and processes the lines
+// starting before end_offset.
+bool SearchingThread::scanGzRange(GzipIndexReader* reader, const GzipIndex& index,
+                                  int point, qint64 end_offset) {
+    static const int BLOCK_SIZE = 4 * 1024 * 1024;
+    qint64 buffer_offset = index.pointOffset(point);
+    if (!reader->seek(buffer_offset)) {
+        if (reader->failed()) {
+            fail(reader->fileName());
+        }
+        return false;
+    }
+    // a line started before the point belongs to the previous range
+    bool skip_first = index.byteBefore(point) != '\n';
+    QByteArray buffer;
+    while (true) {
+        if (!keepSearching()) {
+            return false;
+        }
+        int old_size = buffer.size();
+        buffer.resize(old_size + BLOCK_SIZE);
+        int got = reader->read(buffer.data() + old_size, BLOCK_SIZE);
+        if (got < 0) {
+            if (reader->failed()) {
+                fail(reader->fileName());
+            }
+            return false;
+        }
+        buffer.resize(old_size + got);
+        bool eof = got == 0;
+        const char* begin = buffer.constData();
+        const char* end = begin + buffer.size();
+        const char* p = begin;
+        if (skip_first) {
+            const char* nl = (const char*)memchr(p, '\n', end - p);
+            if (!nl) {
+                if (eof) {
+                    return true;
+                }
+                buffer_offset += buffer.size();
+                buffer.clear();
+                continue;
+            }
+            p = nl + 1;
+            skip_first = false;
+        }
+        // lines starting before limit are ours
+        qint64 limit = end_offset - buffer_offset;
+        const char* stop = eof ? end : lastLineEnd(p, end);
+        bool done = eof;
+        if (limit <= p - begin) {
+            return true;
+        } else if (limit <= end - begin) {
+            const char* nl = (const char*)memchr(begin + limit - 1, '\n', end - (begin + limit - 1));
+            if (nl) {
+                stop = nl + 1;
+                done = true;
+            }
+        }
+        if (!scanLines(p, stop)) {
+            return false;
+        }
+        if (done) {
+            return true;
+        }
+        buffer_offset += stop - begin;
+        buffer.remove(0, stop - begin);
+    }
+}
+
+// [begin, end) must hold complete lines
+bool SearchingThread::scanLines(const char* begin, const char* end) {
+    const char* line = begin;
+    if (!hasKeys() && anchored_ && matcher_.isBytewise()) {
+        // jump straight to the lines containing the anchor term anywhere,
+        // processLine checks the whole query
+        while (line < end) {
+            const char* hit = matcher_.find(line, end - line);
+            if (!hit) {
+                break;
+            }
+            const char* line_begin = hit;
+            while (line_begin > line && line_begin[-1] != '\n') {
+                line_begin--;
+            }
+            const char* nl = (const char*)memchr(hit, '\n', end - hit);
+            const char* line_end = nl ? nl + 1 : end;
+            if (!processLine(line_begin, line_end - line_begin)) {
+                return false;
+            }
+            line = line_end;
+        }
+    } else {
+        while (line < end) {
+            const char* nl = (const char*)memchr(line, '\n', end - line);
+            const char* line_end = nl ? nl + 1 : end;
+            if (!processLine(line, line_end - line)) {
+                return false;
+            }
+            line = line_end;
+        }
+    }
+    return true;
+}
+
+bool SearchingThread::processLine(const char* line, int size) {
+    if (!keepSearching()) {
+        return false;
+    }
+    if (!hasKeys() && anchored_) {
+        // most lines fail on the anchor term, before the line is split
+        const char* name;
+        int name_size;
+        if (!nameField(line, size, &name, &name_size) ||
+            !matcher_.matches(name, name_size)) {
+            return true;
+        }
+    }
+    RecordFields fields;
+    QueryRecord record(&fields);
+    if (!splitRecord(line, size, &fields) || !wanted(record)) {
+        return true;
+    }
+    if (top_field_ >= 0) {
+        return addTop(record.number(top_field_), int(record.number(FIELD_ID)),
+                      -1, line, size);
+    }
+    return addRecord(fields);
+}
+
+// The record is parsed before the mutex is taken, so scanners parse in
+// parallel and only append under it.
+bool SearchingThread::addRecord(const RecordFields& fields) {
+    if (!keepSearching()) {
+        return false;
+    }
+    ResultRecord record(fields, cp1251_ ? codec_ : 0);
+    QMutexLocker locker(&mutex_);
+    if (hits_ >= limit_) {
+        return false;
+    }
+    chunk_->append(record);
+    hits_ += 1;
+    if (hits_ >= limit_) {
+        stopped_.fetchAndStoreOrdered(1);
+        return false;
+    }
+    if (chunk_->size() < chunk_limit_) {
+        return true;
+    }
+    ResultStore_ptr full = chunk_;
+    chunk_ = ResultStore_ptr(new ResultStore);
+    chunk_limit_ = qMin(chunk_limit_ * 2, 1000);
+    // a full ring blocks the delivery, the other scanners go on meanwhile
+    locker.unlock();
+    deliver(full);
+    return true;
+}
+
+bool SearchingThread::betterHit(const TopHit& a, const TopHit& b) {
+    // older topics win ties, whichever scanner saw them first
+    return a.key > b.key || (a.key == b.key && a.id < b.id);
+}
+
+// The heap is ordered by betterHit, so its front is the worst kept hit
+// and a better one replaces it in O(log limit).
+bool SearchingThread::addTop(qint64 key, int id, int row, const char* line, int size) {
+    if (!keepSearching()) {
+        return false;
+    }
+    if (top_ascending_) {
+        key = -key;
+    }
+    int floor = top_floor_;
+    if (floor > INT_MIN && key < floor) {
+        return true;
+    }
+    TopHit hit;
+    hit.key = key;
+    hit.id = id;
+    hit.row = row;
+    QMutexLocker locker(&mutex_);
+    hits_ += 1;
+    if (top_.size() < limit_) {
+        hit.line = QByteArray(line, size);
+        top_ << hit;
+        std::push_heap(top_.begin(), top_.end(), betterHit);
+    } else if (betterHit(hit, top_.front())) {
+        hit.line = QByteArray(line, size);
+        std::pop_heap(top_.begin(), top_.end(), betterHit);
+        top_.back() = hit;
+        std::push_heap(top_.begin(), top_.end(), betterHit);
+    }
+    if (top_.size() == limit_) {
+        top_floor_ = int(qBound(qint64(INT_MIN), top_.front().key, qint64(INT_MAX)));
+    }
+    return true;
+}
+
+void SearchingThread::emitTop(const DumpSnapshot* snapshot) {
+    qDebug() << "top hits:" << top_.size() << "of" << hits_;
+    std::sort(top_.begin(), top_.end(), betterHit);
+    ResultStore_ptr results(new ResultStore);
+    foreach (const TopHit& hit, top_) {
+        RecordFields fields;
+        if (hit.row < 0) {
+            if (splitRecord(hit.line.constData(), hit.line.size(), &fields)) {
+                results->append(ResultRecord(fields, cp1251_ ? codec_ : 0));
+            }
+        } else if (snapshot) {
+            QByteArray name = QByteArray::fromRawData(snapshot->nameData(hit.row),
+                                                      snapshot->nameSize(hit.row));
+            if (cp1251_) {
+                name = codec_->toUnicode(name).toUtf8();
+            }
+            results->append(snapshot->id(hit.row), name, snapshot->torrentSize(hit.row),
+                            snapshot->seeds(hit.row), snapshot->leeches(hit.row),
+                            QByteArray::fromRawData(snapshot->hashData(hit.row),
+                                                    DumpSnapshot::HASH_SIZE),
+                            snapshot->downloads(hit.row), snapshot->updated(hit.row));
+        }
+    }
+    top_.clear();
+    if (results->size() > 0) {
+        deliver(results);
+    }
+}
@@ -0,0 +1,151 @@
+#ifndef SEARCHING_THREAD_H
+#define SEARCHING_THREAD_H
+
+#include <QtCore>
+#include "gzip_pipeline.h"
+#include "name_matcher.h"
+#include "result_store.h"
+#include "result_ring.h"
+#include "search_query.h"
+
+class ChunkQueue;
+class GzipIndex;
+class GzipIndexReader;
+class DumpSnapshot;
+class NameIndex;
+typedef QSharedPointer<DumpSnapshot> DumpSnapshot_ptr;
+
+class SearchingThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    // how run() found the hits
+    enum Plan {
+        PLAN_NONE,       // not run yet
+        PLAN_KEYS,       // hash and id indexes
+        PLAN_NAME_INDEX, // trigram candidates of the name terms
+        PLAN_SNAPSHOT,   // every row of the snapshot
+        PLAN_SCAN        // every line of the dump
+    };
+
+    // the search runs until the limit or until stop()
+    SearchingThread(QIODevice* input, int limit, QString pattern, bool cp1251);
+    // look for records with these 20 byte info-hashes or topic ids
+    // instead of the query
+    void setHashes(const QSet<QByteArray>& hashes);
+    void setTopicIds(const QSet<int>& ids);
+    // an open snapshot of the dump, shared by searches of a long-lived
+    // process; without it the snapshot is mapped for each search
+    void setSnapshot(DumpSnapshot_ptr snapshot);
+    // keep the limit best hits by a numeric field of dump_line.h, largest
+    // first unless ascending, instead of the first hits in file order;
+    // they go out sorted once the scan is over
+    void setTopBy(int field, bool ascending = false);
+    // results go into the ring instead of newResults; a full
+    // ring holds the search up until it is drained or stopped
+    void setRing(ResultRing_ptr ring);
+    // thread safe; the scanners stop soon after, and run() still emits
+    // stopFilling once they are done
+    void stop();
+    void run();
+    // valid once run() returns, for benchmarks and checks
+    Plan plan() const {
+        return plan_;
+    }
+    // true if the dump broke off while it was read, so hits may be
+    // missing; valid once run() returns
+    bool broken() const {
+        return broken_ != 0;
+    }
+signals:
+    void newResults(ResultStore_ptr results);
+    void stopFilling();
+private:
+    QIODevice* input_;
+    int limit_;
+    bool cp1251_;
+    QTextCodec* codec_;
+    SearchQuery query_;
+    // the name term every hit contains, if any; scanners jump to it
+    bool anchored_;
+    NameMatcher matcher_;
+    QSet<QByteArray> hashes_;
+    QSet<int> ids_;
+    DumpSnapshot_ptr snapshot_;
+    ResultRing_ptr ring_;
+    // one producer of the ring at a time
+    QMutex deliver_mutex_;
+    // hits_ and chunk_ are shared by the chunk scanners
+    QMutex mutex_;
+    int hits_;
+    ResultStore_ptr chunk_;
+    int chunk_limit_; // grows, so the first hits go out at once
+    QAtomicInt stopped_; // the limit is reached or the search is cancelled
+    QAtomicInt cancelled_; // by stop()
+    QAtomicInt broken_;
+
+    // A hit of the top mode: a snapshot row, or else a raw dump line.
+    struct TopHit {
+        qint64 key; // negated when ascending, larger is better
+        int id;
+        int row;
+        QByteArray line;
+    };
+    int top_field_;
+    bool top_ascending_;
+    // heap with the worst kept hit in front, under mutex_
+    QVector<TopHit> top_;
+    // key of the worst kept hit once the heap is full, clamped down to
+    // int; hits below it are dropped without taking the mutex
+    QAtomicInt top_floor_;
+    Plan plan_;
+
+    bool keepSearching() const {
+        return stopped_ == 0;
+    }
+    // stops the scanners on a dump which can not be read
+    void fail(const QString& path);
+    // to the ring or as a signal, never under mutex_; waits while the ring
+    // is full
+    void deliver(ResultStore_ptr results);
+    bool hasKeys() const {
+        return !hashes_.isEmpty() || !ids_.isEmpty();
+    }
+    // true if the record is a hit, by the keys or else by the query
+    bool wanted(const QueryRecord& record) const;
+    // offsets of the records with the wanted hashes or ids, false if
+    // there is no index to tell or the query has no keys
+    bool keyOffsets(const QString& path, QVector<qint64>* offsets);
+    // lines whose names may hold a name term every hit contains, in file
+    // order; false if the index can not tell
+    bool termOffsets(const NameIndex& index, QVector<qint64>* offsets);
+    // the snapshot, if any, gives the rows of the hits
+    void lookupOffsets(const QVector<qint64>& offsets, const DumpSnapshot* snapshot,
+                       QFile* file, GzipIndexReader* reader);
+    // rows of the snapshot go out as ResultStore chunks, without text
+    void scanSnapshot(const DumpSnapshot& snapshot);
+    bool addSnapshotRow(const DumpSnapshot& snapshot, int row, ResultStore_ptr& results);
+    void scanParallel(QFile* file);
+    void scanParallelGz(const QString& path, QSharedPointer<GzipIndex> index);
+    void runQueue(QSharedPointer<ChunkQueue> queue);
+    // false if the input is not gzip
+    bool scanPipeline(const QString& path);
+    bool scanBlock(const GzipPipeline::Block& block);
+    // scanners return false when the search must stop
+    bool scanRange(QFile* file, qint64 begin, qint64 end);
+    bool scanGzRange(GzipIndexReader* reader, const GzipIndex& index,
+                     int point, qint64 end);
+    bool scanLines(const char* begin, const char* end);
+    // thread safe, return false when the search must stop
+    bool processLine(const char* line, int size);
+    bool addRecord(const RecordFields& fields);
+    // thread safe, false when the search must stop
+    bool addTop(qint64 key, int id, int row, const char* line, int size);
+    // snapshot holds the rows of the kept hits, if any
+    void emitTop(const DumpSnapshot* snapshot);
+    static bool betterHit(const TopHit& a, const TopHit& b);
+
+    friend class ChunkQueue;
+    friend class PipelineTask;
+};
+
+#endif // SEARCHING_THREAD_H
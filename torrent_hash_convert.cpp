@@ -23,3 +23,23 @@ QString torrent_hash_convert(const QString& input, bool output_base32) {
         return hex_to_base32(input);
     }
 }
+
+QByteArray torrent_hash_bytes(const QString& input) {
+    QByteArray data(input.toUtf8());
+    if (input.length() == 32) {
+        base32Decode(data);
+        return data;
+    } else {
+        return QByteArray::fromHex(data);
+    }
+}
+
+QString torrent_hash_string(const QByteArray& bytes, bool output_base32) {
+    if (output_base32) {
+        QByteArray data(bytes);
+        base32Encode(data);
+        return data;
+    } else {
+        return bytes.toHex().toUpper();
+    }
+}
@@ -10,4 +10,9 @@ QString base32_to_hex(const QString& base32);
 // guess input by length
 QString torrent_hash_convert(const QString& input, bool output_base32);
 
+// 20 bytes of a hex or base32 hash, guessed by length
+QByteArray torrent_hash_bytes(const QString& input);
+
+QString torrent_hash_string(const QByteArray& bytes, bool output_base32);
+
 #endif // TORRENT_HASH_CONVERT_H
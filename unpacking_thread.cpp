@@ -0,0 +1,74 @@
+#include "unpacking_thread.h"
+#include "gzip_pipeline.h"
+#include "dump_indexer.h"
+
+namespace {
+
+const qint64 PROGRESS_INTERVAL = 250; // ms
+
+} // end of anonymous namespace
+
+UnpackingThread::UnpackingThread(QString gz_path, QString path):
+    gz_path_(gz_path), path_(path) {
+}
+
+void UnpackingThread::run() {
+    QElapsedTimer timer;
+    timer.start();
+    qint64 gz_size = qMax(qint64(1), QFileInfo(gz_path_).size());
+    GzipPipeline pipeline(gz_path_);
+    QFile out(path_);
+    // blocks are large, buffering them again is a waste
+    if (!pipeline.start() ||
+        !out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        emit finished(false, path_);
+        return;
+    }
+    DumpIndexer indexer;
+    qint64 offset = 0;
+    qint64 reported = 0;
+    bool ok = true;
+    GzipPipeline::Block block;
+    while (pipeline.next(&block)) {
+        ok = writeLines(&out, &indexer, block.joined.constData(), block.joined.size()) &&
+             writeLines(&out, &indexer, block.data, block.size);
+        offset += block.joined.size() + block.size;
+        pipeline.release(block);
+        if (!ok) {
+            qDebug() << "can not write" << path_;
+            pipeline.cancel();
+            break;
+        }
+        qint64 elapsed = timer.elapsed();
+        if (elapsed - reported >= PROGRESS_INTERVAL) {
+            reported = elapsed;
+            emit progress(int(block.in_pos * 100 / gz_size),
+                          offset / (1024.0 * 1024.0) / (elapsed / 1000.0));
+        }
+    }
+    ok = ok && !pipeline.failed();
+    out.close();
+    if (!ok) {
+        QFile::remove(path_);
+        emit finished(false, path_);
+        return;
+    }
+    qDebug() << "unpacked" << offset << "bytes in" << timer.elapsed() << "ms";
+    // the indexes are a bonus, they can be built again from the menu
+    if (!indexer.save(path_)) {
+        qDebug() << "can not save search index of" << path_;
+    }
+    emit finished(true, path_);
+}
+
+bool UnpackingThread::writeLines(QFile* out, DumpIndexer* indexer,
+                                 const char* data, int size) {
+    if (size == 0) {
+        return true;
+    }
+    if (out->write(data, size) != size) {
+        return false;
+    }
+    indexer->addLines(data, size);
+    return true;
+}
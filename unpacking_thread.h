@@ -0,0 +1,27 @@
+#ifndef UNPACKING_THREAD_H
+#define UNPACKING_THREAD_H
+
+#include <QtCore>
+
+class DumpIndexer;
+
+// Unpacks final.txt.gz in the background. Inflating runs ahead in the
+// gzip pipeline while this thread writes the blocks out and feeds them to
+// the trigram index and the snapshot, so the dump is read only once.
+class UnpackingThread : public QObject, public QRunnable {
+    Q_OBJECT
+public:
+    UnpackingThread(QString gz_path, QString path);
+    void run();
+signals:
+    // percent of the compressed file read, megabytes written per second
+    void progress(int percent, double speed);
+    void finished(bool ok, QString path);
+private:
+    QString gz_path_;
+    QString path_;
+
+    bool writeLines(QFile* out, DumpIndexer* indexer, const char* data, int size);
+};
+
+#endif // UNPACKING_THREAD_H